@@ -0,0 +1,265 @@
+#ifndef BOARD_H_INCLUDED
+#define BOARD_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "rng.h"
+#include "pool.h"
+
+/* planes of the board, interleaved per word */
+enum { MINE, OPEN, FLAG, NPLANES };
+
+/* tiles of large boards are 64x64 cells, one word per tile row */
+#define TILE_SHIFT  6
+/* dense boards use a single tile, every coordinate maps to tile 0 */
+#define DENSE_SHIFT 30
+/* largest boards, dense ones up to the expert size in a single tile, the
+ * others tiled */
+#define DENSE_MAX_W 30
+#define DENSE_MAX_H 64
+#define LARGE_MAX   (1 << 20)
+/* upper bound for the flood fill worklist */
+#define RING_MAX    (1 << 16)
+/* changed fields remembered for the renderer */
+#define DIRTY_MAX   4096
+
+typedef struct Cell {
+    int x, y;
+} Cell;
+
+/* block of cells
+ * one bit per cell in each of the mine/open/flag planes, rows padded to
+ * whole 64 bit words, followed by a 4 bit plane holding the neighbouring
+ * bombs (two cells per byte, low nibble first) */
+typedef struct Tile {
+    bool nbReady;       /* nb plane is valid */
+    uint64_t bits[];
+} Tile;
+
+/* neighbourhoods a board can have, see topo.c */
+enum { TOPO_SQUARE, TOPO_TORUS, TOPO_HEX, TOPO_CROSS, NTOPOS };
+
+/* neighbours of a field as offsets, one table for even and one for odd
+ * rows since rows of hexagonal boards are shifted against each other
+ * offsets stay within one field in either direction, so whole rows are
+ * counted with a halo of one field around every tile */
+typedef struct Topology {
+    const char *name;
+    int n;                  /* neighbours of a field */
+    int dx[2][8], dy[2][8];
+    bool box;               /* the 8 fields around, counted by the fast kernels */
+    bool wrap;              /* edges continue on the opposite side */
+    bool shift;             /* odd rows sit half a field to the right */
+} Topology;
+
+extern const Topology topologies[NTOPOS];
+
+struct Board;
+struct Regions;
+struct Journal;
+
+/* engine specialised at compile time for one board size, see fixed.c */
+typedef struct Engine {
+    int w, h;
+    long (*fill)(struct Board *, int, int);     /* openFields */
+    void (*count)(struct Board *, Tile *);      /* countTile */
+} Engine;
+
+/* packed board, stored in tiles
+ * dense boards consist of one tile covering the whole board, tiled boards
+ * only allocate a tile once one of its cells is written
+ * all memory of a board comes from one arena, mapped when the board is
+ * set up, with a fixed place for every tile. pages of tiles never written
+ * are never touched, and passes over the whole board only visit the
+ * allocated tiles listed in used */
+typedef struct Board {
+    int w, h;
+    long tot;           /* total cells */
+    bool tiled;
+    bool armed;         /* bombs are set */
+    int tshift;         /* log2 of tile size in cells */
+    int tmask;
+    int tw, th;         /* tile size in cells */
+    int rw;             /* words per tile row */
+    int ns;             /* bytes per tile row in nb plane */
+    long twords;        /* words per tile in bit planes */
+    int ntx, nty;       /* tiles across and down */
+    long ntiles;        /* allocated tiles */
+    Tile **tiles;
+    long *used;         /* slots of the allocated tiles, ntiles of them */
+    char *arena;        /* tile table, worklists and tiles */
+    size_t arenaSize;
+    char *tileBase;     /* tiles in the arena, NULL if they did not fit */
+    size_t tileStride;
+    const Topology *topo;
+    const Engine *engine;   /* specialised engine, NULL for the generic one */
+    struct Regions *regions;    /* zero regions labelled whenever bombs are
+                                 * placed, NULL if none are attached */
+    struct Journal *journal;    /* moves to undo, NULL if none is attached */
+    /* endless boards derive the bombs of a tile from the seed once it is
+     * allocated, see lazy.c */
+    bool lazy;
+    uint64_t lazyLimit;     /* hashes below are bombs */
+    Cell safe;              /* first uncovered field, never a bomb */
+    char *map;          /* saved game the tiles may point into, or NULL */
+    size_t mapSize;
+    Cell *ring;         /* flood fill worklist */
+    int ringSize;       /* power of two */
+    Cell *spill;        /* worklist beyond the ring, malloced when needed */
+    long nspill, spillSize;
+    uint64_t seed;
+    Rng rng;
+    /* game state, kept up to date by every move */
+    long bombs;
+    long opened;        /* uncovered fields */
+    long left;          /* safe fields still covered */
+    long flags;
+    /* fields changed since the last frame */
+    Cell *dirty;
+    int ndirty, dirtySize;
+    bool redraw;        /* too many changes, draw everything */
+} Board;
+
+/* settings of a game */
+typedef struct Spec {
+    int w, h;
+    double prob;        /* mine probability, used if mines < 0 */
+    long mines;
+    uint64_t seed;
+    bool tiled;
+    bool noGuess;       /* board must be solvable without guessing */
+    bool lazy;          /* endless board, bombs derived as it is explored */
+    bool regions;       /* label zero regions for 3BV and uncovering them whole */
+    int topo;           /* TOPO_*, square by default */
+    Pool *pool;         /* generates no-guess boards, may be NULL */
+} Spec;
+
+typedef struct Coord {
+    int x, y;
+    char c;     /* command: C uncover, F flag, O chord */
+} Coord;
+
+
+int initFields(Board *, int, int, bool);
+void freeFields(Board *);
+void seedFields(Board *, uint64_t);
+long setBombs(Board *, double, Coord *);
+long setMines(Board *, long, Coord *);
+long placeBombs(Board *, const Spec *, Coord *);
+long placeNoGuess(Board *, const Spec *, Coord *);
+long setLazy(Board *, double, Coord *);
+bool lazyMine(const Board *, int, int);
+uint64_t lazyWord(const Board *, long, int);
+void lazyFill(Board *, Tile *, int, int);
+void coverFields(Board *);
+void clearFields(Board *);
+void resetFields(Board *, uint64_t);
+void moveBomb(Board *, int, int, int, int);
+long copyBombs(Board *, const Board *);
+int saveFields(const Board *, const char *);
+int loadFields(Board *, const char *);
+bool allOpen(const Board *);
+bool step(Board *, Coord *);
+void showMines(Board *);
+void showBomb(Board *, int, int);
+long openFields(Board *, int, int);
+long fillFields(Board *, int, int);
+int rand_one(Rng *, double);
+Tile *tileAlloc(Board *, int, int);
+int tileNb(Board *, int, int);
+void countTile(Board *, Tile *, int, int);
+const Engine *fixedEngine(int, int);
+void setTopology(Board *, int);
+int topologyByName(const char *);
+
+
+static inline bool inBoard(const Board *b, int x, int y)
+{
+    return (unsigned)x < (unsigned)b->w && (unsigned)y < (unsigned)b->h;
+}
+
+/* neighbour i < b->topo->n of x, y
+ * returns false if it lies outside the board */
+static inline bool neighbour(const Board *b, int x, int y, int i, Cell *c)
+{
+    const Topology *t = b->topo;
+
+    c->x = x + t->dx[y & 1][i];
+    c->y = y + t->dy[y & 1][i];
+    if (!t->wrap)
+        return inBoard(b, c->x, c->y);
+    c->x += c->x < 0 ? b->w : c->x >= b->w ? -b->w : 0;
+    c->y += c->y < 0 ? b->h : c->y >= b->h ? -b->h : 0;
+    return true;
+}
+
+static inline Tile **tileSlot(const Board *b, int x, int y)
+{
+    return &b->tiles[(long)(y >> b->tshift) * b->ntx + (x >> b->tshift)];
+}
+
+/* tile containing given cell, NULL if it was never written */
+static inline Tile *tileAt(const Board *b, int x, int y)
+{
+    return *tileSlot(b, x, y);
+}
+
+static inline uint8_t *tileNbPlane(const Board *b, Tile *t)
+{
+    return (uint8_t *)(t->bits + b->twords);
+}
+
+static inline uint64_t *tileWord(const Board *b, Tile *t, int p, int x, int y)
+{
+    x &= b->tmask;
+    y &= b->tmask;
+    return t->bits + ((long)y * b->rw + (x >> 6)) * NPLANES + p;
+}
+
+/* fields of tiles never written are clear, except for the bombs of
+ * endless boards */
+static inline bool testBit(const Board *b, int p, int x, int y)
+{
+    Tile *t = tileAt(b, x, y);
+    if (t)
+        return *tileWord(b, t, p, x, y) >> (x & 63) & 1;
+    return p == MINE && b->lazy && lazyMine(b, x, y);
+}
+
+static inline Tile *tileFor(Board *b, int x, int y)
+{
+    Tile *t = tileAt(b, x, y);
+    return t ? t : tileAlloc(b, x, y);
+}
+
+static inline void setBit(Board *b, int p, int x, int y)
+{
+    *tileWord(b, tileFor(b, x, y), p, x, y) |= 1ULL << (x & 63);
+}
+
+static inline void toggleBit(Board *b, int p, int x, int y)
+{
+    *tileWord(b, tileFor(b, x, y), p, x, y) ^= 1ULL << (x & 63);
+}
+
+/* remember changed field for the renderer */
+static inline void markDirty(Board *b, int x, int y)
+{
+    if (b->ndirty < b->dirtySize)
+        b->dirty[b->ndirty++] = (Cell){x, y};
+    else
+        b->redraw = true;
+}
+
+/* neighbouring bombs, counted per tile on first access */
+static inline int cellNb(Board *b, int x, int y)
+{
+    Tile *t = tileAt(b, x, y);
+    if (!t || !t->nbReady)
+        return tileNb(b, x, y);
+    x &= b->tmask;
+    y &= b->tmask;
+    return tileNbPlane(b, t)[(long)y * b->ns + (x >> 1)] >> ((x & 1) << 2) & 0xf;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+#include "board.h"
+
+/* bits of one word of a plane flipped by a move */
+typedef struct Edit {
+    int x, y;           /* first field of the word */
+    int plane;          /* OPEN or FLAG */
+    uint64_t mask;
+} Edit;
+
+/* moves made on a board, for taking them back and making them again
+ * every move is the list of words it changed, so undo and redo only touch
+ * what the move touched. attached to a board every step begins a move and
+ * everything uncovering or flagging fields adds to it, moves which change
+ * nothing are not kept. placing bombs or covering the board starts the
+ * journal over. */
+typedef struct Journal {
+    Board *b;
+    Edit *edits;
+    long nedits, editsSize;
+    long *moves;        /* first edit of every move */
+    long nmoves, movesSize;
+    long pos;           /* moves in effect, the ones after it are redone */
+    bool started;       /* edits go to the last move, else start a new one */
+} Journal;
+
+
+void journalInit(Journal *, Board *);
+void journalFree(Journal *);
+void journalClear(Journal *);
+void journalBegin(Journal *);
+void journalAdd(Journal *, int, int, int, uint64_t);
+bool journalUndo(Journal *);
+bool journalRedo(Journal *);
+
+/* note bits of the word holding x, y flipped in plane p, if a journal is
+ * attached */
+static inline void journalNote(Board *b, int p, int x, int y, uint64_t mask)
+{
+    if (b->journal && mask)
+        journalAdd(b->journal, p, x & ~63, y, mask);
+}
+
+#endif
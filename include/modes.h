@@ -0,0 +1,29 @@
+#ifndef MODES_H_INCLUDED
+#define MODES_H_INCLUDED
+
+#include "board.h"
+#include "solver.h"
+#include "prob.h"
+#include "regions.h"
+#include "journal.h"
+
+/* non-interactive ways to run the game, each returns an exit status */
+
+int runBatch(const char *, const Spec *);
+int runAutoplay(const Spec *);
+int runSimulate(long, const Spec *);
+int runServe(const char *, int, const Spec *);
+
+/* result of a game played by the solver */
+typedef struct Outcome {
+    long moves;
+    long guesses;       /* moves that were not certain */
+    bool won;
+    bool lost;
+    bool badFlag;       /* lost by a certain move, i.e. a wrong flag */
+    long bbbv;          /* 3BV of the board, 0 if it is not labelled */
+} Outcome;
+
+void autoplay(Solver *, Prob *, const Spec *, Outcome *);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+/* fixed set of worker threads running indexed jobs
+ * the calling thread takes part as worker 0, a NULL pool runs everything
+ * on the calling thread */
+typedef struct Pool Pool;
+
+/* job for index i, run by worker w */
+typedef void (*Job)(void *, long, int);
+
+
+Pool *poolCreate(int);
+void poolDestroy(Pool *);
+int poolSize(const Pool *);
+void poolRun(Pool *, Job, void *, long);
+int cpuCount(void);
+
+#endif
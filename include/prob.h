@@ -0,0 +1,38 @@
+#ifndef PROB_H_INCLUDED
+#define PROB_H_INCLUDED
+
+#include "board.h"
+#include "pool.h"
+
+/* components larger than this many search nodes are estimated instead of
+ * enumerated */
+#define PROB_BUDGET (1L << 24)
+/* frontiers costing more than this many products to combine over their
+ * total bomb count weight every component on its own instead */
+#define PROB_COMBINE (1L << 26)
+
+/* bomb probabilities of covered fields
+ * the frontier, covered fields next to open numbers, is split into
+ * independent components whose configurations are enumerated exactly and
+ * weighted by the number of ways to place the remaining bombs on all other
+ * covered fields. flagged fields are taken as known bombs. */
+typedef struct Prob {
+    Board *b;
+    Pool *pool;         /* enumerates components in parallel, may be NULL */
+    long nfront;
+    long *front;        /* frontier fields as index y*w + x, ascending */
+    double *p;          /* their bomb probability */
+    double rest;        /* probability of any other covered field */
+    long nrest;         /* number of those fields */
+    Cell restCell;      /* one of them */
+    bool exact;         /* no component ran over budget, combined exactly */
+} Prob;
+
+
+void probInit(Prob *, Board *, Pool *);
+void probFree(Prob *);
+int probCompute(Prob *);
+double probAt(const Prob *, int, int);
+bool probBest(const Prob *, Coord *);
+
+#endif
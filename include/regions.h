@@ -0,0 +1,45 @@
+#ifndef REGIONS_H_INCLUDED
+#define REGIONS_H_INCLUDED
+
+#include "board.h"
+#include "pool.h"
+
+/* boards up to this many fields are labelled */
+#define REGIONS_MAX (1L << 24)
+
+/* label of fields outside every zero region */
+#define NO_REGION   UINT32_MAX
+
+/* field of a region, while labelling */
+typedef struct Pair {
+    uint32_t region, cell;
+} Pair;
+
+/* connected zero fields of a board with its bombs placed
+ * every region lists its zero fields and the numbers around them, which
+ * is what uncovering any of its zero fields opens. attached to a board
+ * the regions are labelled again whenever bombs are placed, and
+ * openFields opens a whole region at once. */
+typedef struct Regions {
+    Board *b;
+    Pool *pool;         /* labels bands of rows in parallel, may be NULL */
+    bool ready;         /* labels match the bombs of the board */
+    uint32_t *label;    /* region of every zero field, NO_REGION else */
+    uint64_t *zero;     /* zero fields, rows of words */
+    int words;          /* per row */
+    uint32_t *start;    /* fields of region r are cells[start[r]...start[r+1]) */
+    uint32_t *cells;    /* field indices y*w + x, ascending per region */
+    long nregions, ncells;
+    long startSize, cellsSize;
+    Pair *pairs;        /* fields by position, sorted into cells */
+    long pairsSize;
+    long bbbv;          /* least number of clicks solving the board */
+} Regions;
+
+
+int regionsInit(Regions *, Board *, Pool *);
+void regionsFree(Regions *);
+void regionsLabel(Regions *);
+long regionsOpen(Regions *, int, int);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RENDER_H_INCLUDED
+#define RENDER_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "board.h"
+
+/* widest board with columns named by letters */
+#define ALPHA_MAX 26
+
+/* terminal renderer
+ * frames are composed in one reusable buffer and written at once, after
+ * the first frame only the fields on the board's dirty list are redrawn.
+ * only the window of the board that fits the terminal is drawn */
+typedef struct Render {
+    int fd;
+    bool large;         /* one character per field, numeric labels */
+    bool drawn;         /* screen holds a full frame */
+    int digits;         /* width of row labels in large mode */
+    int cols, rows;     /* terminal size */
+    int vx, vy;         /* top left field of the window */
+    int vw, vh;         /* window size in fields */
+    bool cursor;        /* highlight the field at cx, cy */
+    int cx, cy;
+    int px, py;         /* cursor position on screen */
+    char *buf;
+    size_t len, cap;
+} Render;
+
+
+void renderInit(Render *, int, const Board *, bool);
+void renderFree(Render *);
+void renderFrame(Render *, Board *, const char *, const char *);
+void printField(Render *, Board *);
+void renderPan(Render *, const Board *, int, int);
+void renderFocus(Render *, const Board *, int, int);
+void renderCursor(Render *, const Board *, int, int);
+
+#endif
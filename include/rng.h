@@ -0,0 +1,64 @@
+#ifndef RNG_H_INCLUDED
+#define RNG_H_INCLUDED
+
+#include <stdint.h>
+
+/* xoshiro256** generator, seeded through splitmix64 */
+typedef struct Rng {
+    uint64_t s[4];
+} Rng;
+
+
+static inline uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static inline void rngSeed(Rng *r, uint64_t seed)
+{
+    int i;
+    for (i = 0; i < 4; ++i)
+        r->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rngNext(Rng *r)
+{
+    uint64_t *s = r->s;
+    uint64_t res = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return res;
+}
+
+/* uniform in [0, n), multiply and reject to avoid modulo bias */
+static inline uint64_t rngBelow(Rng *r, uint64_t n)
+{
+    unsigned __int128 m = (unsigned __int128)rngNext(r) * n;
+    uint64_t lo = (uint64_t)m, t;
+
+    if (lo < n) {
+        t = -n % n;
+        while (lo < t) {
+            m = (unsigned __int128)rngNext(r) * n;
+            lo = (uint64_t)m;
+        }
+    }
+    return m >> 64;
+}
+
+#endif
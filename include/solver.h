@@ -0,0 +1,27 @@
+#ifndef SOLVER_H_INCLUDED
+#define SOLVER_H_INCLUDED
+
+#include "board.h"
+
+/* deterministic solver
+ * keeps a worklist of open numbers whose surroundings changed, picked up
+ * from the board's dirty list, and only re-examines those. flagged fields
+ * are taken as known bombs. */
+typedef struct Solver {
+    Board *b;
+    Cell *work;         /* numbers to examine, ring of workSize */
+    long head, tail, workSize;
+    uint64_t *queued;   /* one bit per field on the worklist */
+    Coord *moves;       /* certain moves found, not yet made */
+    long nmoves, movesSize;
+} Solver;
+
+
+int solverInit(Solver *, Board *);
+void solverReset(Solver *);
+void solverFree(Solver *);
+void solverNote(Solver *);
+bool solverNext(Solver *, Coord *);
+long solve(Solver *);
+
+#endif
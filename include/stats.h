@@ -0,0 +1,83 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+/* hot path counters, compiled in with -DSTATS (make ms_stats)
+ * without STATS every macro below expands to nothing. the counters are
+ * dumped as JSON to stderr at the end of a game and on SIGUSR1, which is
+ * looked for between the commands of play and batch, the moves of the
+ * solver in autoplay and simulate and the events of every serve loop. */
+
+#ifdef STATS
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct Stats {
+    long fills;         /* openFields calls */
+    long cellsOpened;
+    long fillMax;       /* most fields opened by one call */
+    long fillDepth;     /* longest flood fill worklist */
+    long fillSpills;    /* fields beyond the worklist ring */
+    long gens;          /* boards generated */
+    long genNs;
+    long labels;        /* zero region labellings */
+    long labelNs;
+    long prints;        /* printField calls */
+    long printNs;
+    long printBytes;
+    long frameBytes;    /* written by renderFrame */
+    long inputs;        /* readCoords calls */
+    long inputNs;       /* waiting for input */
+} Stats;
+
+extern Stats stats;
+extern volatile sig_atomic_t statsRequested;
+
+void statsInit(void);
+void statsDump(void);
+
+static inline long statNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void statMax(long *p, long v)
+{
+    long cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(p, &cur, v, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+#define STAT_ADD(field, n)      __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_MAX(field, v)      statMax(&stats.field, (v))
+/* local maximum, for counters updated in inner loops */
+#define STAT_LOCAL(var, init)   long var = (init)
+#define STAT_TRACK(var, v)      do { if ((long)(v) > var) var = (v); } while (0)
+#define STAT_CLOCK(var)         long var = statNow()
+#define STAT_SINCE(field, var)  STAT_ADD(field, statNow() - var)
+#define STATS_INIT()            statsInit()
+#define STATS_DUMP()            statsDump()
+/* only one of the threads polling dumps a request */
+#define STATS_POLL()            do { if (statsRequested && __atomic_exchange_n(&statsRequested, 0, \
+                                        __ATOMIC_RELAXED)) statsDump(); } while (0)
+
+#else
+
+#define STAT_ADD(field, n)
+#define STAT_MAX(field, v)
+#define STAT_LOCAL(var, init)
+#define STAT_TRACK(var, v)
+#define STAT_CLOCK(var)
+#define STAT_SINCE(field, var)
+#define STATS_INIT()
+#define STATS_DUMP()
+#define STATS_POLL()
+
+#endif
+
+#endif
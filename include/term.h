@@ -0,0 +1,14 @@
+#ifndef TERM_H_INCLUDED
+#define TERM_H_INCLUDED
+
+/* raw terminal input
+ * keys are read as soon as they are typed, without echo, and decoded into
+ * characters or one of the codes below */
+enum { KEY_UP = 256, KEY_DOWN, KEY_RIGHT, KEY_LEFT };
+
+
+int termRaw(int, int);
+void termRestore(void);
+int readKeys(int *, int);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "modes.h"
+#include "stats.h"
+#include "render.h"
+#include "solver.h"
+#include "prob.h"
+
+/* play the game on b from the middle of the board until it is won, lost or
+ * no move is left, the board must be seeded and not yet armed
+ * when no certain move is left the field least likely to hold a bomb is
+ * opened */
+void autoplay(Solver *s, Prob *p, const Spec *spec, Outcome *o)
+{
+    Board *b = s->b;
+    Coord first = { spec->w / 2, spec->h / 2, 'C' }, guess;
+    long n;
+
+    o->moves = 1;
+    o->guesses = 0;
+    o->badFlag = false;
+    placeBombs(b, spec, &first);
+    o->bbbv = b->regions && b->regions->ready ? b->regions->bbbv : 0;
+    o->lost = step(b, &first);
+
+    while (!o->lost) {
+        STATS_POLL();
+        n = solve(s);
+        if (n < 0) {
+            o->lost = o->badFlag = true;
+            break;
+        }
+        o->moves += n;
+        if (allOpen(b) || probCompute(p) || !probBest(p, &guess))
+            break;
+        ++o->moves;
+        ++o->guesses;
+        o->lost = step(b, &guess);
+    }
+    o->won = !o->lost && allOpen(b);
+}
+
+
+/* let the solver play a game and show where it got */
+int runAutoplay(const Spec *spec)
+{
+    Board board;
+    Solver solver;
+    Render render;
+    Prob prob;
+    Regions regions;
+    Pool *pool = poolCreate(0);
+    Outcome o;
+    char status[128], prompt[128];
+
+    if (initFields(&board, spec->w, spec->h, spec->tiled)
+            || solverInit(&solver, &board)) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        return EXIT_FAILURE;
+    }
+    seedFields(&board, spec->seed);
+    probInit(&prob, &board, pool);
+    /* labelled if asked for, too large boards are flooded */
+    memset(&regions, 0, sizeof(regions));
+    if (spec->regions)
+        regionsInit(&regions, &board, pool);
+    autoplay(&solver, &prob, spec, &o);
+
+    if (o.badFlag)
+        snprintf(status, sizeof(status), "solver hit a bomb");
+    else if (o.lost)
+        snprintf(status, sizeof(status), "lost after %ld moves, %ld guesses",
+                o.moves, o.guesses);
+    else if (o.won && regions.ready)
+        snprintf(status, sizeof(status), "solved in %ld moves, %ld guesses, 3BV %ld",
+                o.moves, o.guesses, o.bbbv);
+    else if (o.won)
+        snprintf(status, sizeof(status), "solved in %ld moves, %ld guesses",
+                o.moves, o.guesses);
+    else
+        snprintf(status, sizeof(status), "stuck after %ld moves, %ld fields left",
+                o.moves, board.left);
+    snprintf(prompt, sizeof(prompt), "seed %llu\n", (unsigned long long)spec->seed);
+
+    /* one character per field and numeric coordinates beyond the letters */
+    renderInit(&render, STDOUT_FILENO, &board, board.tiled || board.w > ALPHA_MAX);
+    renderFrame(&render, &board, status, prompt);
+    STATS_DUMP();
+
+    renderFree(&render);
+    regionsFree(&regions);
+    probFree(&prob);
+    poolDestroy(pool);
+    solverFree(&solver);
+    freeFields(&board);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "modes.h"
+#include "stats.h"
+
+/* headless replay of move scripts
+ *
+ *   # comment
+ *   seed 42             seed of the next board
+ *   board 30 16 99      width, height and mines, starts a new game
+ *   C 3 4               uncover x y
+ *   F 5 6               flag x y
+ *   O 3 4               chord x y, uncover the neighbours of a number
+ *                       once it has as many flags around it
+ *   U [N]               take back the last N moves, one by default
+ *   R [N]               make N moves taken back again
+ *
+ * moves before the first board line play on the board given on the
+ * command line, moves after a game ended are ignored until one is taken
+ * back. only the outcome of every game and the total timing are printed. */
+
+typedef struct Batch {
+    Board board;
+    Regions regions;    /* attached if asked for and the board is not too large */
+    Journal journal;
+    Pool *pool;
+    bool ready;         /* board is initialised */
+    bool active;        /* a game is being played */
+    bool first;         /* bombs not yet placed */
+    bool over;
+    bool lost;
+    Cell hit;           /* bomb uncovered by the last lost move */
+    long moves;
+    double start;
+} Batch;
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* start a game, on the board of the last one if it has the same size */
+static int startGame(Batch *g, const Spec *s)
+{
+    Board *b = &g->board;
+
+    if (g->ready && b->w == s->w && b->h == s->h && b->tiled == s->tiled
+            && b->topo == &topologies[s->topo]) {
+        resetFields(b, s->seed);
+    }
+    else {
+        if (g->ready) {
+            journalFree(&g->journal);
+            regionsFree(&g->regions);
+            freeFields(b);
+        }
+        g->ready = false;
+        if (initFields(b, s->w, s->h, s->tiled))
+            return -1;
+        g->ready = true;
+        setTopology(b, s->topo);
+        seedFields(b, s->seed);
+        memset(&g->regions, 0, sizeof(g->regions));
+        if (s->regions)
+            regionsInit(&g->regions, b, g->pool);
+        journalInit(&g->journal, b);
+    }
+    g->active = true;
+    g->first = true;
+    g->over = false;
+    g->lost = false;
+    g->hit = (Cell){ 0, 0 };
+    g->moves = 0;
+    g->start = now();
+    return 0;
+}
+
+
+/* find out whether the game is over after a move or taking one back, the
+ * bomb of a lost move stays uncovered until the move is taken back */
+static void settle(Batch *g)
+{
+    g->lost = testBit(&g->board, MINE, g->hit.x, g->hit.y)
+        && testBit(&g->board, OPEN, g->hit.x, g->hit.y);
+    g->over = g->lost || allOpen(&g->board);
+}
+
+
+/* print outcome of the current game */
+static void endGame(Batch *g, long *won, long *lost)
+{
+    const char *res = g->lost ? "lost" : g->over ? "won" : "open";
+
+    *won += g->over && !g->lost;
+    *lost += g->lost;
+    printf("%s moves=%ld opened=%ld/%ld", res, g->moves,
+            g->board.opened, g->board.tot - g->board.bombs);
+    if (g->regions.ready)
+        printf(" 3bv=%ld", g->regions.bbbv);
+    printf(" usec=%.0f\n", (now() - g->start) * 1e6);
+    g->active = false;
+}
+
+
+int runBatch(const char *path, const Spec *defaults)
+{
+    FILE *in = path ? fopen(path, "r") : stdin;
+    char line[256], cmd;
+    Spec spec = *defaults;
+    Batch g;
+    Coord next;
+    long lineno = 0, games = 0, won = 0, lost = 0, moves = 0;
+    unsigned long long seed;
+    double start;
+    int w, h, n, count;
+    long mines;
+
+    if (!in) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    g.pool = spec.pool;
+    g.ready = false;
+    g.active = false;
+    start = now();
+    while (fgets(line, sizeof(line), in)) {
+        ++lineno;
+        STATS_POLL();
+        if (sscanf(line, " %c", &cmd) != 1 || cmd == '#')
+            continue;
+
+        if (sscanf(line, " seed %llu", &seed) == 1) {
+            spec.seed = seed;
+        }
+        else if (sscanf(line, " board %d %d %ld", &w, &h, &mines) == 3) {
+            /* wider or taller than dense boards are tiled, up to the
+             * size of large boards on the command line */
+            if (w < 1 || h < 1 || w > LARGE_MAX || h > LARGE_MAX
+                    || mines < 0 || mines >= (long)w * h) {
+                fprintf(stderr, "line %ld: invalid board\n", lineno);
+                continue;
+            }
+            if (g.active)
+                endGame(&g, &won, &lost);
+            spec.w = w;
+            spec.h = h;
+            spec.mines = mines;
+            spec.tiled = w > DENSE_MAX_W || h > DENSE_MAX_H;
+            if (startGame(&g, &spec))
+                goto nomem;
+            ++games;
+        }
+        else if (sscanf(line, " %c %d %d", &cmd, &next.x, &next.y) == 3
+                && (toupper(cmd) == 'C' || toupper(cmd) == 'F'
+                    || toupper(cmd) == 'O')) {
+            if (!g.active) {
+                if (startGame(&g, &spec))
+                    goto nomem;
+                ++games;
+            }
+            if (g.over)
+                continue;
+            if (!inBoard(&g.board, next.x, next.y)) {
+                fprintf(stderr, "line %ld: invalid coordinate\n", lineno);
+                continue;
+            }
+            next.c = toupper(cmd);
+            if (g.first) {
+                placeBombs(&g.board, &spec, &next);
+                g.first = false;
+            }
+            ++g.moves;
+            ++moves;
+            if (step(&g.board, &next)) {
+                /* taking the move back covers the bomb again */
+                showBomb(&g.board, next.x, next.y);
+                g.hit = (Cell){ next.x, next.y };
+            }
+            settle(&g);
+        }
+        else if ((n = sscanf(line, " %c %d", &cmd, &count)) >= 1
+                && (toupper(cmd) == 'U' || toupper(cmd) == 'R')) {
+            if (n == 1)
+                count = 1;
+            if (!g.active || g.first || count < 1) {
+                fprintf(stderr, "line %ld: nothing to %s\n", lineno,
+                        toupper(cmd) == 'U' ? "undo" : "redo");
+                continue;
+            }
+            while (count-- && (toupper(cmd) == 'U' ? journalUndo(&g.journal)
+                        : journalRedo(&g.journal)))
+                ;
+            settle(&g);
+        }
+        else {
+            fprintf(stderr, "line %ld: invalid command\n", lineno);
+        }
+    }
+    if (g.active)
+        endGame(&g, &won, &lost);
+    if (g.ready) {
+        journalFree(&g.journal);
+        regionsFree(&g.regions);
+        freeFields(&g.board);
+    }
+
+    start = now() - start;
+    printf("games=%ld won=%ld lost=%ld moves=%ld sec=%.6f moves/s=%.0f\n",
+            games, won, lost, moves, start, start > 0 ? moves / start : 0.);
+    STATS_DUMP();
+
+    if (in != stdin)
+        fclose(in);
+    return EXIT_SUCCESS;
+
+nomem:
+    if (g.ready) {
+        journalFree(&g.journal);
+        regionsFree(&g.regions);
+        freeFields(&g.board);
+    }
+    fprintf(stderr, "Failed to allocate memory!\n");
+    if (in != stdin)
+        fclose(in);
+    return EXIT_FAILURE;
+}
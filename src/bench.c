@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "board.h"
+#include "regions.h"
+#include "journal.h"
+#include "render.h"
+#include "parg.h"
+
+/* timings of the engine's hot paths
+ *
+ * every operation runs on a matrix of board sizes and bomb densities and
+ * prints one line
+ *
+ *   bench op=NAME w=W h=H p=P reps=N ns_op=T ns_cell=T allocs_op=A maxrss_kb=K
+ *
+ * ns_op is taken from the fastest of a few rounds, ns_cell is per field of
+ * the board. maxrss_kb is the peak of the whole
+ * process so far, the cases run from small to large boards. allocations
+ * are counted by wrapping malloc, calloc and realloc at link time.
+ *
+ *   bench.out [-q] [-s SEED]             run the matrix, quick runs
+ *                                        measure shorter and skip the
+ *                                        largest boards
+ *   bench.out -c OLD NEW [-t PERCENT]    compare two runs, fails on any
+ *                                        operation slower by more than
+ *                                        PERCENT (default 10) */
+
+#define USAGE "Usage: bench.out [-q] [-s SEED]\n"\
+              "       bench.out -c OLD NEW [-t PERCENT]"
+
+/* measure every operation for about this long, split into rounds */
+#define TARGET_SEC  0.2
+#define QUICK_SEC   0.02
+#define ROUNDS      5
+
+static const struct { int w, h; bool tiled; } sizes[] = {
+    { 9, 9, false }, { 16, 16, false }, { 30, 16, false }, { 26, 64, false },
+    { 256, 256, true }, { 1024, 1024, true }, { 4096, 4096, true },
+};
+static const double densities[] = { 0.10, 0.16, 0.21 };
+
+/* moves per board of the step benchmark */
+#define STEPS       (1 << 16)
+/* boards skipped by a quick run */
+#define QUICK_MAX   (1L << 20)
+
+#define LEN(a) (sizeof(a) / sizeof(*(a)))
+
+
+/* allocation counter */
+static long allocs;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t n)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n)
+{
+    __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, n);
+}
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* time spent and allocations made by the measured part of an operation
+ * the time is measured in rounds, the fastest round counts */
+typedef struct Meter {
+    double sec, start;  /* of the current round */
+    long reps;          /* of the current round */
+    double best;        /* seconds per operation */
+    long total, allocs, startAllocs;
+    int rounds;
+} Meter;
+
+static void meterReset(Meter *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->best = 1e30;
+}
+
+static void meterStart(Meter *m)
+{
+    m->startAllocs = allocs;
+    m->start = now();
+}
+
+static void meterStop(Meter *m)
+{
+    m->sec += now() - m->start;
+    m->allocs += allocs - m->startAllocs;
+    ++m->reps;
+}
+
+/* close the round once it took long enough
+ * returns true after the last round */
+static bool meterDone(Meter *m, double target)
+{
+    if (m->sec < target / ROUNDS)
+        return false;
+    if (m->sec / m->reps < m->best)
+        m->best = m->sec / m->reps;
+    m->total += m->reps;
+    m->sec = 0;
+    m->reps = 0;
+    return ++m->rounds == ROUNDS;
+}
+
+
+static void report(const char *op, const Board *b, double p, const Meter *m)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("bench op=%s w=%d h=%d p=%.2f reps=%ld ns_op=%.1f ns_cell=%.4g "
+            "allocs_op=%.2f maxrss_kb=%ld\n", op, b->w, b->h, p, m->total,
+            m->best * 1e9, m->best * 1e9 / b->tot,
+            (double)m->allocs / m->total, ru.ru_maxrss);
+    fflush(stdout);
+}
+
+
+static void noMem(void)
+{
+    fprintf(stderr, "Failed to allocate memory!\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* fresh board of the size of b with bombs, first click in the middle */
+static void arm(Board *b, int w, int h, bool tiled, double p, uint64_t seed)
+{
+    Coord first = { w / 2, h / 2, 'C' };
+
+    if (initFields(b, w, h, tiled))
+        noMem();
+    seedFields(b, seed);
+    setBombs(b, p, &first);
+}
+
+
+/* n moves on random fields, flagging bombs and uncovering the rest */
+static void randomMoves(Board *b, Coord *moves, long n)
+{
+    long i, k;
+
+    for (i = 0; i < n; ++i) {
+        k = rngBelow(&b->rng, b->tot);
+        moves[i] = (Coord){ k % b->w, k / b->w, 0 };
+        moves[i].c = testBit(b, MINE, moves[i].x, moves[i].y) ? 'F' : 'C';
+    }
+}
+
+
+static void runCase(int w, int h, bool tiled, double p, uint64_t seed, double target)
+{
+    Board b;
+    Regions reg;
+    Journal jr;
+    Coord first = { w / 2, h / 2, 'C' };
+    Meter m;
+    Render r;
+    Coord *moves;
+    long i, n;
+    int fd;
+    volatile bool sink;
+
+    /* initFields */
+    meterReset(&m);
+    do {
+        meterStart(&m);
+        if (initFields(&b, w, h, tiled))
+            noMem();
+        meterStop(&m);
+        freeFields(&b);
+    } while (!meterDone(&m, target));
+    b.w = w;
+    b.h = h;
+    b.tot = (long)w * h;
+    report("initFields", &b, p, &m);
+
+    /* resetFields of a played board */
+    arm(&b, w, h, tiled, p, seed);
+    openFields(&b, w / 2, h / 2);
+    meterReset(&m);
+    do {
+        meterStart(&m);
+        resetFields(&b, seed);
+        meterStop(&m);
+    } while (!meterDone(&m, target));
+    report("resetFields", &b, p, &m);
+    freeFields(&b);
+
+    /* setBombs */
+    meterReset(&m);
+    do {
+        if (initFields(&b, w, h, tiled))
+            noMem();
+        seedFields(&b, seed + m.total + m.reps);
+        meterStart(&m);
+        setBombs(&b, p, &first);
+        meterStop(&m);
+        freeFields(&b);
+    } while (!meterDone(&m, target));
+    report("setBombs", &b, p, &m);
+
+    /* openFields from the first click */
+    meterReset(&m);
+    do {
+        arm(&b, w, h, tiled, p, seed + m.total + m.reps);
+        meterStart(&m);
+        openFields(&b, w / 2, h / 2);
+        meterStop(&m);
+        freeFields(&b);
+    } while (!meterDone(&m, target));
+    report("openFields", &b, p, &m);
+
+    /* regionsLabel of an armed board, and openFields from the first click
+     * opening whole regions */
+    arm(&b, w, h, tiled, p, seed);
+    if (!regionsInit(&reg, &b, NULL)) {
+        meterReset(&m);
+        do {
+            meterStart(&m);
+            regionsLabel(&reg);
+            meterStop(&m);
+        } while (!meterDone(&m, target));
+        report("regionsLabel", &b, p, &m);
+        regionsFree(&reg);
+        freeFields(&b);
+
+        meterReset(&m);
+        do {
+            if (initFields(&b, w, h, tiled) || regionsInit(&reg, &b, NULL))
+                noMem();
+            seedFields(&b, seed + m.total + m.reps);
+            setBombs(&b, p, &first);
+            meterStart(&m);
+            openFields(&b, w / 2, h / 2);
+            meterStop(&m);
+            regionsFree(&reg);
+            freeFields(&b);
+        } while (!meterDone(&m, target));
+        report("regionsOpen", &b, p, &m);
+    }
+    else {
+        freeFields(&b);
+    }
+
+    /* allOpen, far too fast for a single call to be timed */
+    arm(&b, w, h, tiled, p, seed);
+    meterReset(&m);
+    do {
+        meterStart(&m);
+        for (i = 0; i < 1000000; ++i)
+            sink = allOpen(&b);
+        meterStop(&m);
+        m.reps += i - 1;
+    } while (!meterDone(&m, target));
+    (void)sink;
+    report("allOpen", &b, p, &m);
+    freeFields(&b);
+
+    /* step on random fields, flagging bombs and uncovering the rest */
+    n = (long)w * h < STEPS ? (long)w * h : STEPS;
+    moves = malloc(n * sizeof(*moves));
+    if (!moves)
+        noMem();
+    meterReset(&m);
+    do {
+        arm(&b, w, h, tiled, p, seed + m.total + m.reps);
+        randomMoves(&b, moves, n);
+        meterStart(&m);
+        for (i = 0; i < n; ++i)
+            step(&b, &moves[i]);
+        meterStop(&m);
+        m.reps += n - 1;
+        freeFields(&b);
+    } while (!meterDone(&m, target));
+    report("step", &b, p, &m);
+
+    /* taking back and making again the moves of step, per move */
+    meterReset(&m);
+    do {
+        arm(&b, w, h, tiled, p, seed + m.total + m.reps);
+        journalInit(&jr, &b);
+        randomMoves(&b, moves, n);
+        for (i = 0; i < n; ++i)
+            step(&b, &moves[i]);
+        meterStart(&m);
+        for (i = 0; journalUndo(&jr); ++i)
+            ;
+        while (journalRedo(&jr))
+            ;
+        meterStop(&m);
+        m.reps += i - 1;
+        journalFree(&jr);
+        freeFields(&b);
+    } while (!meterDone(&m, target));
+    free(moves);
+    report("journalUndo", &b, p, &m);
+
+    /* printField of a half open board into /dev/null */
+    fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        perror("/dev/null");
+        exit(EXIT_FAILURE);
+    }
+    arm(&b, w, h, tiled, p, seed);
+    openFields(&b, w / 2, h / 2);
+    for (i = 0; i < b.tot; i += 2)
+        if (!testBit(&b, MINE, i % w, i / w))
+            setBit(&b, OPEN, i % w, i / w);
+    renderInit(&r, fd, &b, tiled || w > ALPHA_MAX);
+    meterReset(&m);
+    do {
+        meterStart(&m);
+        r.len = 0;
+        printField(&r, &b);
+        if (write(fd, r.buf, r.len) < 0)
+            perror("write");
+        meterStop(&m);
+    } while (!meterDone(&m, target));
+    report("printField", &b, p, &m);
+    renderFree(&r);
+    freeFields(&b);
+    close(fd);
+}
+
+
+/* result line of a run */
+typedef struct Result {
+    char op[32];
+    int w, h;
+    double p, ns;
+} Result;
+
+static long readResults(const char *path, Result **out)
+{
+    FILE *f = fopen(path, "r");
+    char line[512];
+    Result *res = NULL, r;
+    long n = 0, size = 0;
+
+    if (!f) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "bench op=%31s w=%d h=%d p=%lf reps=%*d ns_op=%lf",
+                    r.op, &r.w, &r.h, &r.p, &r.ns) != 5)
+            continue;
+        if (n == size) {
+            size = size ? 2 * size : 64;
+            res = realloc(res, size * sizeof(*res));
+            if (!res)
+                noMem();
+        }
+        res[n++] = r;
+    }
+    fclose(f);
+    *out = res;
+    return n;
+}
+
+
+/* print the ratio of every operation found in both runs
+ * returns number of regressions */
+static int compare(const char *oldPath, const char *newPath, double threshold)
+{
+    Result *a, *b;
+    long na = readResults(oldPath, &a), nb = readResults(newPath, &b), i, j;
+    int regressions = 0;
+    double ratio;
+
+    for (j = 0; j < nb; ++j) {
+        for (i = 0; i < na; ++i)
+            if (!strcmp(a[i].op, b[j].op) && a[i].w == b[j].w && a[i].h == b[j].h
+                    && a[i].p == b[j].p)
+                break;
+        if (i == na)
+            continue;
+        ratio = b[j].ns / a[i].ns;
+        printf("compare op=%s w=%d h=%d p=%.2f old_ns=%.1f new_ns=%.1f ratio=%.3f%s\n",
+                b[j].op, b[j].w, b[j].h, b[j].p, a[i].ns, b[j].ns, ratio,
+                ratio > 1 + threshold / 100 ? " REGRESSION" : "");
+        regressions += ratio > 1 + threshold / 100;
+    }
+    free(a);
+    free(b);
+    return regressions;
+}
+
+
+int main(int argc, char **argv)
+{
+    struct parg_state ps;
+    int c;
+    size_t i, j;
+    uint64_t seed = 1;
+    double target = TARGET_SEC, threshold = 10;
+    const char *cmp = NULL, *against = NULL;
+
+    parg_init(&ps);
+    while ((c = parg_getopt(&ps, argc, argv, "qs:c:t:")) != -1) {
+        switch (c) {
+            case 'q':
+                target = QUICK_SEC;
+                break;
+            case 's':
+                seed = strtoull(ps.optarg, NULL, 0);
+                break;
+            case 'c':
+                cmp = ps.optarg;
+                break;
+            case 't':
+                threshold = atof(ps.optarg);
+                break;
+            case 1:     /* second file of -c */
+                against = ps.optarg;
+                break;
+            default:
+                puts(USAGE);
+                return EXIT_FAILURE;
+        }
+    }
+    if (cmp || against) {
+        if (!cmp || !against) {
+            puts(USAGE);
+            return EXIT_FAILURE;
+        }
+        return compare(cmp, against, threshold) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    for (i = 0; i < LEN(sizes); ++i) {
+        if (target == QUICK_SEC && (long)sizes[i].w * sizes[i].h > QUICK_MAX)
+            continue;
+        for (j = 0; j < LEN(densities); ++j)
+            runCase(sizes[i].w, sizes[i].h, sizes[i].tiled, densities[j], seed, target);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,574 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "board.h"
+#include "regions.h"
+#include "journal.h"
+#include "stats.h"
+
+/* tiles of tiled boards start on a page of their own */
+#define ARENA_ALIGN 4096
+
+
+/* bytes of a tile with its bit and nb planes */
+static size_t tileSize(const Board *b)
+{
+    return sizeof(Tile) + b->twords * sizeof(uint64_t) + (size_t)b->th * b->ns;
+}
+
+
+static size_t roundUp(size_t n, size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+
+/* zeroed arena, tiled boards reserve address space of which pages are
+ * only backed once they are written, dense boards are small enough for
+ * the heap */
+static char *reserve(const Board *b, size_t n)
+{
+    char *p;
+
+    if (!b->tiled)
+        return calloc(n, 1);
+    p = mmap(NULL, n, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+
+/* set up tile geometry and init members
+ * the arena holds the tile table, the worklists and a place for every
+ * tile, dense boards allocate their single tile right away
+ * returns errorcode */
+int initFields(Board *b, int w, int h, bool tiled)
+{
+    size_t used, ring, dirty, head;
+
+    b->w        = w;
+    b->h        = h;
+    b->tot      = (long)w * h;
+    b->tiled    = tiled;
+    b->armed    = false;
+    b->tshift   = tiled ? TILE_SHIFT : DENSE_SHIFT;
+    b->tmask    = (1 << b->tshift) - 1;
+    b->tw       = tiled ? 1 << TILE_SHIFT : w;
+    b->th       = tiled ? 1 << TILE_SHIFT : h;
+    b->rw       = (b->tw + 63) / 64;
+    b->ns       = (b->tw + 1) / 2;
+    b->twords   = (long)b->th * b->rw * NPLANES;
+    b->ntx      = ((w - 1) >> b->tshift) + 1;
+    b->nty      = ((h - 1) >> b->tshift) + 1;
+    b->ntiles   = 0;
+    b->map      = NULL;
+    b->mapSize  = 0;
+    b->bombs    = 0;
+    b->opened   = 0;
+    b->left     = b->tot;
+    b->flags    = 0;
+    b->topo     = &topologies[TOPO_SQUARE];
+    b->engine   = fixedEngine(w, h);
+    b->regions  = NULL;
+    b->journal  = NULL;
+    b->spill    = NULL;
+    b->nspill   = b->spillSize = 0;
+    b->lazy     = false;
+    b->safe     = (Cell){ -1, -1 };
+
+    /* the fill front rarely grows beyond twice the perimeter */
+    for (b->ringSize = 16; b->ringSize < 4L * (w + h) && b->ringSize < RING_MAX;)
+        b->ringSize <<= 1;
+
+    b->dirtySize = b->tot < DIRTY_MAX ? b->tot : DIRTY_MAX;
+    b->ndirty = 0;
+    b->redraw = true;
+
+    /* tile table, used slots, ring, dirty list, then the tiles on their
+     * own pages */
+    used = (size_t)b->ntx * b->nty * sizeof(*b->tiles);
+    ring = used + (size_t)b->ntx * b->nty * sizeof(*b->used);
+    dirty = ring + b->ringSize * sizeof(*b->ring);
+    head = roundUp(dirty + b->dirtySize * sizeof(*b->dirty),
+            tiled ? ARENA_ALIGN : 64);
+    b->tileStride = roundUp(tileSize(b), 64);
+    b->arenaSize = head + (size_t)b->ntx * b->nty * b->tileStride;
+    b->arena = reserve(b, b->arenaSize);
+    b->tileBase = b->arena + head;
+    if (!b->arena && tiled) {
+        /* too large to reserve, allocate tiles one by one */
+        b->arenaSize = head;
+        b->arena = reserve(b, b->arenaSize);
+        b->tileBase = NULL;
+    }
+    if (!b->arena)
+        return -1;
+    b->tiles = (Tile **)b->arena;
+    b->used = (long *)(b->arena + used);
+    b->ring = (Cell *)(b->arena + ring);
+    b->dirty = (Cell *)(b->arena + dirty);
+    if (!tiled)
+        tileAlloc(b, 0, 0);
+
+    return 0;
+}
+
+
+void freeFields(Board *b)
+{
+    long i;
+    char *t;
+
+    if (!b->tileBase) {
+        for (i = 0; i < b->ntiles; ++i) {
+            t = (char *)b->tiles[b->used[i]];
+            /* tiles of a loaded game live in its mapping */
+            if (!b->map || t < b->map || t >= b->map + b->mapSize)
+                free(t);
+        }
+    }
+    if (b->map)
+        munmap(b->map, b->mapSize);
+    b->map = NULL;
+    if (b->tiled)
+        munmap(b->arena, b->arenaSize);
+    else
+        free(b->arena);
+    b->arena = NULL;
+    b->tileBase = NULL;
+    b->tiles = NULL;
+    b->used = NULL;
+    b->ring = NULL;
+    b->dirty = NULL;
+    free(b->spill);
+    b->spill = NULL;
+    b->nspill = b->spillSize = 0;
+}
+
+
+/* allocate the tile containing given cell, from its place in the arena
+ * if there is one */
+Tile *tileAlloc(Board *b, int x, int y)
+{
+    Tile **slot = tileSlot(b, x, y);
+
+    if (b->tileBase)
+        *slot = (Tile *)(b->tileBase + (slot - b->tiles) * b->tileStride);
+    else
+        *slot = calloc(tileSize(b), 1);
+    if (!*slot) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    b->used[b->ntiles++] = slot - b->tiles;
+    if (b->lazy)
+        lazyFill(b, *slot, x >> b->tshift, y >> b->tshift);
+
+    return *slot;
+}
+
+
+/* slow path of cellNb: count the tile of given cell first */
+int tileNb(Board *b, int x, int y)
+{
+    Tile *t;
+
+    if (!b->armed)
+        return 0;
+    t = tileFor(b, x, y);
+    countTile(b, t, x >> b->tshift, y >> b->tshift);
+    return cellNb(b, x, y);
+}
+
+
+/* seed the generator used to place bombs */
+void seedFields(Board *b, uint64_t seed)
+{
+    b->seed = seed;
+    rngSeed(&b->rng, seed);
+}
+
+
+/* bombs are placed, count neighbours
+ * tiled boards count their tiles on demand */
+static void armFields(Board *b, long bombs)
+{
+    b->armed = true;
+    b->bombs = bombs;
+    b->left = b->tot - bombs - b->opened;
+    if (!b->tiled)
+        countTile(b, b->tiles[0], 0, 0);
+    if (b->regions)
+        regionsLabel(b->regions);
+    if (b->journal)
+        journalClear(b->journal);
+}
+
+
+/* randomly distribute bombs
+ * make sure, the first uncovered field is empty */
+long setBombs(Board *b, double prob, Coord *init)
+{
+    long bombs;
+    int x, y;
+    STAT_CLOCK(start);
+
+    bombs = 0;
+    for (y = 0; y < b->h; ++y) {
+        for (x = 0; x < b->w; ++x) {
+            if (x == init->x && y == init->y)
+                continue;
+            if (rand_one(&b->rng, prob)) {
+                setBit(b, MINE, x, y);
+                ++bombs;
+            }
+        }
+    }
+    armFields(b, bombs);
+    STAT_ADD(gens, 1);
+    STAT_SINCE(genNs, start);
+
+    return bombs;
+}
+
+
+/* distribute exactly given number of bombs, sampling cell indices with
+ * Floyd's algorithm, skipping the first uncovered field
+ * returns number of bombs */
+long setMines(Board *b, long mines, Coord *init)
+{
+    long n = b->tot - 1, first = (long)init->y * b->w + init->x;
+    long j, i;
+    int x, y;
+    STAT_CLOCK(start);
+
+    if (mines > n)
+        mines = n;
+    for (j = n - mines; j < n; ++j) {
+        i = rngBelow(&b->rng, j + 1);
+        i += i >= first;
+        x = i % b->w;
+        y = i / b->w;
+        if (testBit(b, MINE, x, y)) {
+            /* already taken, take j itself which is never chosen before */
+            i = j + (j >= first);
+            x = i % b->w;
+            y = i / b->w;
+        }
+        setBit(b, MINE, x, y);
+    }
+    armFields(b, mines);
+    STAT_ADD(gens, 1);
+    STAT_SINCE(genNs, start);
+
+    return mines;
+}
+
+
+/* distribute bombs as given by the game settings */
+long placeBombs(Board *b, const Spec *s, Coord *init)
+{
+    if (s->lazy)
+        return setLazy(b, s->mines < 0 ? s->prob : (double)s->mines / b->tot, init);
+    if (s->noGuess)
+        return placeNoGuess(b, s, init);
+    return s->mines < 0 ? setBombs(b, s->prob, init) : setMines(b, s->mines, init);
+}
+
+
+/* take back all moves, bombs stay where they are */
+void coverFields(Board *b)
+{
+    long i, k;
+    uint64_t *bits;
+
+    for (i = 0; i < b->ntiles; ++i) {
+        bits = b->tiles[b->used[i]]->bits;
+        for (k = 0; k < b->twords; k += NPLANES)
+            bits[k + OPEN] = bits[k + FLAG] = 0;
+    }
+    b->opened = 0;
+    b->left = b->tot - b->bombs;
+    b->flags = 0;
+    b->ndirty = 0;
+    b->redraw = true;
+    if (b->journal)
+        journalClear(b->journal);
+}
+
+
+/* remove bombs and moves, bombs can be placed again afterwards
+ * tiles stay allocated and are only zeroed */
+void clearFields(Board *b)
+{
+    long i;
+
+    for (i = 0; i < b->ntiles; ++i)
+        memset(b->tiles[b->used[i]], 0, tileSize(b));
+    b->armed = false;
+    b->lazy = false;
+    b->safe = (Cell){ -1, -1 };
+    if (b->regions)
+        b->regions->ready = false;
+    if (b->journal)
+        journalClear(b->journal);
+    b->bombs = 0;
+    b->opened = 0;
+    b->left = b->tot;
+    b->flags = 0;
+    b->ndirty = 0;
+    b->redraw = true;
+}
+
+
+/* start a new game with given seed on the board in place, without
+ * allocating anything */
+void resetFields(Board *b, uint64_t seed)
+{
+    clearFields(b);
+    seedFields(b, seed);
+}
+
+
+/* move the bomb at fx, fy to the free field tx, ty
+ * the numbers around both are counted again on next access */
+void moveBomb(Board *b, int fx, int fy, int tx, int ty)
+{
+    int i;
+    Cell c;
+    Tile *t;
+
+    toggleBit(b, MINE, fx, fy);
+    setBit(b, MINE, tx, ty);
+    if (b->regions)
+        b->regions->ready = false;
+    for (i = 0; i < b->topo->n; ++i) {
+        if (neighbour(b, fx, fy, i, &c) && (t = tileAt(b, c.x, c.y)))
+            t->nbReady = false;
+        if (neighbour(b, tx, ty, i, &c) && (t = tileAt(b, c.x, c.y)))
+            t->nbReady = false;
+    }
+    tileAt(b, fx, fy)->nbReady = false;
+    tileAt(b, tx, ty)->nbReady = false;
+}
+
+
+/* place the bombs of src, a board of the same size, on b */
+long copyBombs(Board *b, const Board *src)
+{
+    long i, j, k;
+    Tile *t;
+
+    for (i = 0; i < src->ntiles; ++i) {
+        j = src->used[i];
+        t = tileFor(b, (j % b->ntx) << b->tshift, (j / b->ntx) << b->tshift);
+        for (k = MINE; k < b->twords; k += NPLANES)
+            t->bits[k] = src->tiles[j]->bits[k];
+    }
+    armFields(b, src->bombs);
+
+    return src->bombs;
+}
+
+
+/* check if all fields are either uncovered or have a bomb
+ * in that case the game is won */
+bool allOpen(const Board *b)
+{
+    return b->armed && b->left == 0;
+}
+
+
+/* uncover the covered, unflagged neighbours of an open number once as
+ * many flags surround it
+ * returns true if one of them was a bomb, next is moved to it */
+static bool chord(Board *b, Coord *next)
+{
+    int x = next->x, y = next->y;
+    int i, flags = 0;
+    bool hit = false;
+    Cell c;
+
+    if (!b->armed || !testBit(b, OPEN, x, y))
+        return false;
+    for (i = 0; i < b->topo->n; ++i)
+        flags += neighbour(b, x, y, i, &c) && testBit(b, FLAG, c.x, c.y);
+    if (flags != cellNb(b, x, y))
+        return false;
+
+    for (i = 0; i < b->topo->n; ++i) {
+        if (!neighbour(b, x, y, i, &c) || testBit(b, OPEN, c.x, c.y)
+                || testBit(b, FLAG, c.x, c.y))
+            continue;
+        if (testBit(b, MINE, c.x, c.y)) {
+            next->x = c.x;
+            next->y = c.y;
+            hit = true;
+        }
+        else {
+            openFields(b, c.x, c.y);
+        }
+    }
+    return hit;
+}
+
+
+/* perform given command (uncover, flag, chord) on given coordinates
+ * every command is a move of the journal, if one is attached */
+bool step(Board *b, Coord *next)
+{
+    int x = next->x, y = next->y;
+
+    if (b->journal)
+        journalBegin(b->journal);
+    if (next->c == 'O')
+        return chord(b, next);
+
+    if (next->c == 'C') {
+        if (testBit(b, FLAG, x, y)) {
+            toggleBit(b, FLAG, x, y);
+            journalNote(b, FLAG, x, y, 1ULL << (x & 63));
+            markDirty(b, x, y);
+            --b->flags;
+        }
+        if (testBit(b, MINE, x, y))
+            return true;
+        else if (!testBit(b, OPEN, x, y))
+            openFields(b, x, y);
+    }
+    else if (next->c == 'F' && !testBit(b, OPEN, x, y)) {
+        toggleBit(b, FLAG, x, y);
+        journalNote(b, FLAG, x, y, 1ULL << (x & 63));
+        markDirty(b, x, y);
+        b->flags += testBit(b, FLAG, x, y) ? 1 : -1;
+    }
+
+    return false;
+}
+
+
+/* uncover all bombs when the game is finished */
+void showMines(Board *b)
+{
+    long i;
+    uint64_t *iter, *end;
+
+    b->redraw = true;
+    for (i = 0; i < b->ntiles; ++i) {
+        iter = b->tiles[b->used[i]]->bits;
+        end = iter + b->twords;
+        for (; iter != end; iter += NPLANES)
+            iter[OPEN] |= iter[MINE];
+    }
+}
+
+
+/* uncover the bomb a move hit, as part of that move */
+void showBomb(Board *b, int x, int y)
+{
+    setBit(b, OPEN, x, y);
+    journalNote(b, OPEN, x, y, 1ULL << (x & 63));
+    markDirty(b, x, y);
+}
+
+
+/* keep a field of the flood fill which did not fit into the ring */
+static void spillCell(Board *b, Cell c)
+{
+    if (b->nspill == b->spillSize) {
+        b->spillSize = b->spillSize ? 2 * b->spillSize : 1024;
+        b->spill = realloc(b->spill, b->spillSize * sizeof(*b->spill));
+        if (!b->spill) {
+            fprintf(stderr, "Failed to allocate memory!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    b->spill[b->nspill++] = c;
+    STAT_ADD(fillSpills, 1);
+}
+
+
+/* open given field and its neighbours, spreading over fields which do not
+ * neighbour to a bomb
+ * labelled boards open whole regions at once, see regions.c
+ * returns number of opened fields */
+long openFields(Board *b, int x, int y)
+{
+    if (b->regions && b->regions->ready)
+        return regionsOpen(b->regions, x, y);
+    return fillFields(b, x, y);
+}
+
+
+/* flood fill of openFields
+ * runs breadth first over the preallocated ring, fields which do not fit
+ * go to the spill list of the board and refill the ring once it is empty
+ * boards of the standard sizes are filled by their engine in fixed.c
+ * returns number of opened fields */
+long fillFields(Board *b, int x, int y)
+{
+    Cell *ring = b->ring;
+    unsigned mask = b->ringSize - 1;
+    unsigned head, tail;
+    int i;
+    Cell c;
+    long opened;
+    STAT_LOCAL(depth, 0);
+
+    if (b->engine)
+        return b->engine->fill(b, x, y);
+    opened = !testBit(b, OPEN, x, y);
+    setBit(b, OPEN, x, y);
+    journalNote(b, OPEN, x, y, (uint64_t)opened << (x & 63));
+    markDirty(b, x, y);
+    head = tail = 0;
+    ring[tail++ & mask] = (Cell){x, y};
+
+    for (;;) {
+        while (head != tail) {
+            x = ring[head & mask].x;
+            y = ring[head & mask].y;
+            ++head;
+            for (i = 0; i < b->topo->n; ++i) {
+                if (!neighbour(b, x, y, i, &c)          \
+                        || testBit(b, MINE, c.x, c.y)   \
+                        || testBit(b, OPEN, c.x, c.y)   \
+                        || testBit(b, FLAG, c.x, c.y))
+                    continue;
+                setBit(b, OPEN, c.x, c.y);
+                journalNote(b, OPEN, c.x, c.y, 1ULL << (c.x & 63));
+                markDirty(b, c.x, c.y);
+                ++opened;
+                if (cellNb(b, c.x, c.y) != 0)
+                    continue;
+                if (tail - head <= mask) {
+                    ring[tail++ & mask] = c;
+                    STAT_TRACK(depth, tail - head);
+                }
+                else
+                    spillCell(b, c);
+            }
+        }
+        if (!b->nspill)
+            break;
+        for (head = tail = 0; b->nspill && tail <= mask;)
+            ring[tail++] = b->spill[--b->nspill];
+    }
+
+    b->opened += opened;
+    b->left -= opened;
+    STAT_ADD(fills, 1);
+    STAT_ADD(cellsOpened, opened);
+    STAT_MAX(fillMax, opened);
+    STAT_MAX(fillDepth, depth);
+    return opened;
+}
+
+
+/* returns 1 with given probability
+ * else returns 0 */
+int rand_one(Rng *r, double prob)
+{
+    return ((rngNext(r) >> 11) * 0x1.0p-53 < prob) ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include "board.h"
+#include "journal.h"
+#include "stats.h"
+
+/* engines for the standard board sizes
+ *
+ * beginner, intermediate and expert boards fit into a single tile with one
+ * word per row. with width and height known at compile time the rows are
+ * kept in local arrays and every pass over the board unrolls: neighbours
+ * are summed on whole rows by a carry save adder, and the flood fill
+ * dilates the fields it opened last until no zero field is left to grow
+ * from. any other size goes through the generic code in board.c and
+ * nbcount.c. */
+
+/* tallest board with an engine */
+#define FIXED_MAX   16
+
+#define ROW(t, p, y) ((t)->bits[(long)(y) * NPLANES + (p)])
+
+#define INLINE static inline __attribute__((always_inline))
+
+
+/* fields of r and the ones left and right of them */
+INLINE uint64_t grow(uint64_t r)
+{
+    return r | r << 1 | r >> 1;
+}
+
+
+/* count neighbouring bombs of every field of a w x h board */
+INLINE void countRows(Board *b, Tile *t, const int w, const int h)
+{
+    const uint64_t full = (1ULL << w) - 1;
+    uint64_t m[FIXED_MAX + 2], s[4];
+    uint64_t i0, i1, i2, i3, i4, i5, i6, i7;
+    uint64_t s1, c1, s2, c2, s3, c3, c4, c5, c6, c;
+    uint8_t *nb;
+    int x, y;
+
+    m[0] = m[h + 1] = 0;
+    for (y = 0; y < h; ++y)
+        m[y + 1] = ROW(t, MINE, y);
+
+    for (y = 0; y < h; ++y) {
+        i0 = m[y] << 1;
+        i1 = m[y];
+        i2 = m[y] >> 1;
+        i3 = m[y + 1] << 1;
+        i4 = m[y + 1] >> 1;
+        i5 = m[y + 2] << 1;
+        i6 = m[y + 2];
+        i7 = m[y + 2] >> 1;
+
+        /* same adder tree as the generic kernel */
+        s1 = i0 ^ i1 ^ i2;
+        c1 = (i0 & i1) | (i2 & (i0 ^ i1));
+        s2 = i3 ^ i4 ^ i5;
+        c2 = (i3 & i4) | (i5 & (i3 ^ i4));
+        s3 = i6 ^ i7;
+        c3 = i6 & i7;
+        c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+        c = c1 ^ c2 ^ c3;
+        c5 = (c1 & c2) | (c3 & (c1 ^ c2));
+        c6 = c & c4;
+        s[0] = (s1 ^ s2 ^ s3) & full;
+        s[1] = (c ^ c4) & full;
+        s[2] = (c5 ^ c6) & full;
+        s[3] = c5 & c6 & full;
+
+        nb = tileNbPlane(b, t) + (long)y * b->ns;
+        for (x = 0; x < w; x += 2)
+            nb[x >> 1] = (s[0] >> x & 1) | (s[1] >> x & 1) << 1
+                | (s[2] >> x & 1) << 2 | (s[3] >> x & 1) << 3
+                | (s[0] >> (x + 1) & 1) << 4 | (s[1] >> (x + 1) & 1) << 5
+                | (s[2] >> (x + 1) & 1) << 6 | (s[3] >> (x + 1) & 1) << 7;
+    }
+    t->nbReady = true;
+}
+
+
+/* uncover x, y and flood the zero fields reachable from it, like
+ * openFields
+ * returns number of uncovered fields */
+INLINE long fillRows(Board *b, int x0, int y0, const int w, const int h)
+{
+    const uint64_t full = (1ULL << w) - 1;
+    Tile *t = tileFor(b, 0, 0);
+    uint64_t mine[FIXED_MAX + 2], zero[FIXED_MAX], shut[FIXED_MAX];
+    uint64_t open[FIXED_MAX], front[FIXED_MAX + 2], next[FIXED_MAX + 2];
+    uint64_t n, any;
+    long opened;
+    int y;
+
+    mine[0] = mine[h + 1] = 0;
+    for (y = 0; y < h; ++y) {
+        mine[y + 1] = ROW(t, MINE, y);
+        open[y] = ROW(t, OPEN, y);
+        shut[y] = mine[y + 1] | ROW(t, FLAG, y);
+    }
+    /* without bombs every field is zero, as cellNb has it */
+    for (y = 0; y < h; ++y)
+        zero[y] = ~(grow(mine[y]) | grow(mine[y + 1]) | grow(mine[y + 2])) & full;
+
+    opened = !(open[y0] >> x0 & 1);
+    open[y0] |= 1ULL << x0;
+    journalNote(b, OPEN, 0, y0, (uint64_t)opened << x0);
+    markDirty(b, x0, y0);
+    for (y = 0; y < h + 2; ++y)
+        front[y] = 0;
+    front[y0 + 1] = 1ULL << x0;
+    next[0] = next[h + 1] = 0;
+
+    do {
+        any = 0;
+        for (y = 0; y < h; ++y) {
+            n = grow(front[y] | front[y + 1] | front[y + 2]) & full
+                & ~shut[y] & ~open[y];
+            open[y] |= n;
+            next[y + 1] = n & zero[y];
+            any |= next[y + 1];
+            opened += __builtin_popcountll(n);
+            journalNote(b, OPEN, 0, y, n);
+            for (; n; n &= n - 1)
+                markDirty(b, __builtin_ctzll(n), y);
+        }
+        for (y = 0; y < h; ++y)
+            front[y + 1] = next[y + 1];
+    } while (any);
+
+    for (y = 0; y < h; ++y)
+        ROW(t, OPEN, y) = open[y];
+    b->opened += opened;
+    b->left -= opened;
+    STAT_ADD(fills, 1);
+    STAT_ADD(cellsOpened, opened);
+    STAT_MAX(fillMax, opened);
+    return opened;
+}
+
+
+#define FIXED_ENGINE(W, H)                                                  \
+static void count##W##x##H(Board *b, Tile *t)                               \
+{                                                                           \
+    countRows(b, t, W, H);                                                  \
+}                                                                           \
+                                                                            \
+static long fill##W##x##H(Board *b, int x, int y)                           \
+{                                                                           \
+    return fillRows(b, x, y, W, H);                                         \
+}
+
+#define ENGINE(W, H) { W, H, fill##W##x##H, count##W##x##H }
+
+FIXED_ENGINE(9, 9)
+FIXED_ENGINE(16, 16)
+FIXED_ENGINE(30, 16)
+
+static const Engine engines[] = {
+    ENGINE(9, 9), ENGINE(16, 16), ENGINE(30, 16),
+};
+
+
+/* engine specialised for boards of given size, NULL if there is none */
+const Engine *fixedEngine(int w, int h)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(engines) / sizeof(*engines); ++i)
+        if (engines[i].w == w && engines[i].h == h)
+            return &engines[i];
+    return NULL;
+}
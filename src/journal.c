@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "journal.h"
+
+/* undo and redo
+ *
+ * the journal only grows while moves are made: every change to the open
+ * and flag planes is appended as the bits it flipped in one word, and
+ * changes to the same word in a row are merged. flipping the bits again
+ * takes a move back, flipping them once more makes it again, so both cost
+ * the words the move changed and never a copy of the board. a move made
+ * after taking some back drops the ones that could have been redone. */
+
+
+static void noMem(void)
+{
+    fprintf(stderr, "Failed to allocate memory!\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* attach an empty journal to the board */
+void journalInit(Journal *j, Board *b)
+{
+    memset(j, 0, sizeof(*j));
+    j->b = b;
+    b->journal = j;
+}
+
+
+void journalFree(Journal *j)
+{
+    if (j->b && j->b->journal == j)
+        j->b->journal = NULL;
+    free(j->edits);
+    free(j->moves);
+    j->edits = NULL;
+    j->moves = NULL;
+    j->nedits = j->nmoves = j->pos = 0;
+    j->started = false;
+}
+
+
+/* forget all moves */
+void journalClear(Journal *j)
+{
+    j->nedits = j->nmoves = j->pos = 0;
+    j->started = false;
+}
+
+
+/* end of the edits of move k */
+static long moveEnd(const Journal *j, long k)
+{
+    return k + 1 < j->nmoves ? j->moves[k + 1] : j->nedits;
+}
+
+
+/* let the next edit start a new move */
+void journalBegin(Journal *j)
+{
+    j->started = false;
+}
+
+
+/* add the bits mask of the word at x, y of plane p to the current move
+ * x is the first field of the word
+ * the first edit of a move drops the moves taken back before */
+void journalAdd(Journal *j, int p, int x, int y, uint64_t mask)
+{
+    Edit *e;
+
+    if (!j->started) {
+        j->nedits = j->pos < j->nmoves ? j->moves[j->pos] : j->nedits;
+        j->nmoves = j->pos;
+        if (j->nmoves == j->movesSize) {
+            j->movesSize = j->movesSize ? 2 * j->movesSize : 256;
+            j->moves = realloc(j->moves, j->movesSize * sizeof(*j->moves));
+            if (!j->moves)
+                noMem();
+        }
+        j->moves[j->nmoves++] = j->nedits;
+        j->pos = j->nmoves;
+        j->started = true;
+    }
+    else if (j->nedits > j->moves[j->nmoves - 1]) {
+        e = &j->edits[j->nedits - 1];
+        if (e->x == x && e->y == y && e->plane == p) {
+            e->mask ^= mask;
+            return;
+        }
+    }
+    if (j->nedits == j->editsSize) {
+        j->editsSize = j->editsSize ? 2 * j->editsSize : 1024;
+        j->edits = realloc(j->edits, j->editsSize * sizeof(*j->edits));
+        if (!j->edits)
+            noMem();
+    }
+    j->edits[j->nedits++] = (Edit){ x, y, p, mask };
+}
+
+
+/* flip the bits of an edit, keeping the counts of the board */
+static void flip(Journal *j, const Edit *e)
+{
+    Board *b = j->b;
+    Tile *t = tileFor(b, e->x, e->y);
+    uint64_t *word = tileWord(b, t, e->plane, e->x, e->y);
+    uint64_t on = e->mask & ~*word, off = e->mask & *word, m;
+    long n;
+
+    *word ^= e->mask;
+    if (e->plane == OPEN) {
+        /* bombs shown at the end of a game are not counted */
+        m = ~*tileWord(b, t, MINE, e->x, e->y);
+        n = __builtin_popcountll(on & m) - __builtin_popcountll(off & m);
+        b->opened += n;
+        b->left -= n;
+    }
+    else {
+        b->flags += __builtin_popcountll(on) - __builtin_popcountll(off);
+    }
+    for (m = e->mask; m; m &= m - 1)
+        markDirty(b, e->x + __builtin_ctzll(m), e->y);
+}
+
+
+/* take back the last move in effect
+ * returns false if there is none */
+bool journalUndo(Journal *j)
+{
+    long i, k;
+
+    if (!j->pos)
+        return false;
+    j->started = false;
+    k = --j->pos;
+    for (i = moveEnd(j, k); i-- > j->moves[k];)
+        flip(j, &j->edits[i]);
+    return true;
+}
+
+
+/* make the move taken back last again
+ * returns false if there is none */
+bool journalRedo(Journal *j)
+{
+    long i, k;
+
+    if (j->pos == j->nmoves)
+        return false;
+    j->started = false;
+    k = j->pos++;
+    for (i = j->moves[k]; i < moveEnd(j, k); ++i)
+        flip(j, &j->edits[i]);
+    return true;
+}
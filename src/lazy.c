@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "board.h"
+#include "journal.h"
+
+/* endless boards
+ *
+ * no bombs are placed up front. whether a field holds a bomb is a hash of
+ * the seed and its coordinates, compared against the density, so any
+ * field can be asked at any time in any order. a tile takes its bombs
+ * from the hash when it is allocated, which happens once a fill, a flag or
+ * a neighbour count reaches it. neighbour counts at tile edges ask the
+ * hash for tiles not allocated yet. memory and time grow with the explored
+ * area only. */
+
+
+static inline uint64_t mix(uint64_t z)
+{
+    return splitmix64(&z);
+}
+
+
+/* bomb at x, y of an endless board */
+bool lazyMine(const Board *b, int x, int y)
+{
+    if (x == b->safe.x && y == b->safe.y)
+        return false;
+    return mix(b->seed ^ mix((uint64_t)(uint32_t)y << 32 | (uint32_t)x)) < b->lazyLimit;
+}
+
+
+/* bombs of fields x...x+63 in row y, x a multiple of 64 */
+uint64_t lazyWord(const Board *b, long x, int y)
+{
+    uint64_t word = 0;
+    int i, n = b->w - x < 64 ? b->w - x : 64;
+
+    for (i = 0; i < n; ++i)
+        word |= (uint64_t)lazyMine(b, x + i, y) << i;
+    return word;
+}
+
+
+/* place the bombs of a newly allocated tile */
+void lazyFill(Board *b, Tile *t, int tx, int ty)
+{
+    long x0 = (long)tx << b->tshift, bombs = 0;
+    int y0 = ty << b->tshift, y, k, rows;
+    uint64_t word;
+
+    rows = b->h - y0 < b->th ? b->h - y0 : b->th;
+    for (y = 0; y < rows; ++y) {
+        for (k = 0; k < b->rw && x0 + 64L*k < b->w; ++k) {
+            word = lazyWord(b, x0 + 64L*k, y0 + y);
+            t->bits[((long)y * b->rw + k) * NPLANES + MINE] = word;
+            bombs += __builtin_popcountll(word);
+        }
+    }
+    b->bombs += bombs;
+    b->left -= bombs;
+}
+
+
+/* make the board endless with given density of bombs, init stays free
+ * tiles allocated before get their bombs now
+ * returns number of bombs known so far */
+long setLazy(Board *b, double prob, Coord *init)
+{
+    long i, k;
+
+    b->lazy = true;
+    b->lazyLimit = prob >= 1 ? UINT64_MAX : (uint64_t)(prob * 0x1p64);
+    b->safe = (Cell){ init->x, init->y };
+    b->armed = true;
+    b->bombs = 0;
+    b->left = b->tot - b->opened;
+    if (b->journal)
+        journalClear(b->journal);
+    for (i = 0; i < b->ntiles; ++i) {
+        k = b->used[i];
+        lazyFill(b, b->tiles[k], k % b->ntx, k / b->ntx);
+    }
+
+    return b->bombs;
+}
@@ -1,92 +1,183 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
 #include "parg.h"
-
-#define DEBUG 0
-
-#define BOLD    "\x1b[1m"
-#define RED     "\x1b[1;97;41m"
-#define RESET   "\x1b[0m"
-const char *colors[] = {"\x1b[1;32m", "\x1b[1;32m", "\x1b[1;32m",     /* green */
-                        "\x1b[1;93m", "\x1b[1;93m", "\x1b[1;93m",
-                        "\x1b[1;91m", "\x1b[1;91m",
-                        "\x1b[1;31m"};
+#include <unistd.h>
+#include "board.h"
+#include "render.h"
+#include "modes.h"
+#include "stats.h"
+#include "term.h"
 
 #define TITLE "MINESWEEPER"
-#define HELP "minesweeper\nUsage: ms [-w WIDTH (8...26)] [-h HEIGHT (8...64)] "\
-             "[-p PROBABILITY (0...100)]"
-
-const char AZ[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-
-typedef struct Field {
-    bool hasBomb;
-    bool isOpen;
-    bool flag;
-    int nb;     /* neighbouring bombs */
-    /* struct Field *u, *ur, *r, *dr, *d, *dl, *l, *ul; */
-    struct Field **nbs;
-} Field;
-
-typedef struct Coord {
-    int x, y;
-    char c;     /* command */
-} Coord;
-
-
-void initFields(Field *, int, int, int);
-int setBombs(Field *, Field *, double, int, Coord *);
-void printField(Field *, int, int);
-int readCoord(Coord *, int, int);
-bool allOpen(Field *, Field *);
-bool step(Field *, Coord *, int, int *);
-void showMines(Field *, Field *);
-void openFields(Field *);
-int rand_one(double);
-void clear();
+#define HELP "minesweeper\nUsage: ms [-w WIDTH (8...30)] [-h HEIGHT (8...64)] "\
+             "[-p PROBABILITY (0...100)] [-n MINES] [-s SEED] [-l] [-g] [-e] "\
+             "[-t TOPOLOGY] [--3bv] "\
+             "[--batch[=FILE]] [--autoplay] [--simulate N] [--load FILE] "\
+             "[--save FILE] [--serve PATH [--loops N]] [--keys]\n"\
+             "  -w  boards wider than 26 take numeric coordinates\n"\
+             "  -n  place exactly MINES bombs instead of using PROBABILITY\n"\
+             "  -s  seed of the board generator\n"\
+             "  -l  large board, WIDTH and HEIGHT up to 1048576, "\
+             "numeric coordinates\n"\
+             "  -g  generate boards that can be solved without guessing\n"\
+             "  -e  endless board, bombs are derived from SEED as the board is "\
+             "explored, large and 1048576x1048576 unless sized\n"\
+             "  -t  neighbourhood of a field: square (default), torus "\
+             "(edges wrap around), hex or cross (4 neighbours)\n"\
+             "  --3bv           label the zero regions of the board, counting "\
+             "its 3BV and uncovering regions at once, not on endless boards\n"\
+             "  --batch[=FILE]  replay moves from FILE or stdin without output\n"\
+             "  --autoplay      let the solver play, guessing the safest field "\
+             "when stuck"\
+             "\n  --simulate N    let the solver play N games with seeds SEED, "\
+             "SEED+1, ... on all cores and print statistics"\
+             "\n  --load FILE     resume the game saved in FILE"\
+             "\n  --save FILE     file the s command saves to, default "\
+             "the loaded file or " SAVE_DEFAULT\
+             "\n  --serve PATH    host games on the unix socket PATH, as large "\
+             "as dense boards or WIDTH x HEIGHT"\
+             "\n  --loops N       event loops of the server, pinned to cores"\
+             "\n  --keys          play with single keys and a cursor on the terminal"
+
+#define PROMPT "Enter commands (c - uncover, f - flag, o - chord) and coordinates "\
+               "(a-z, 0-xx), e.g. cA3 fB4, h/j/k/l [N] to scroll, u/r [N] to "\
+               "undo or redo or s to save: "
+#define PROMPT_LARGE "Enter commands (c - uncover, f - flag, o - chord) and "\
+                     "coordinates (x y), e.g. c 3 4 f 5 6, h/j/k/l [N] to scroll, "\
+                     "u/r [N] to undo or redo or s to save: "
+#define PROMPT_KEYS "arrows or hjkl move, space uncovers or chords, f flags, "\
+                    "o chords, u undoes, r redoes, s saves, q quits"
+
+/* commands read from a single line */
+#define CMDS_MAX 64
+
+#define SAVE_DEFAULT "ms.save"
+
+extern const char AZ[];
+
+static const struct parg_option longopts[] = {
+    {"batch", PARG_OPTARG, NULL, 'b'},
+    {"autoplay", PARG_NOARG, NULL, 'a'},
+    {"simulate", PARG_REQARG, NULL, 'm'},
+    {"load", PARG_REQARG, NULL, 'r'},
+    {"save", PARG_REQARG, NULL, 'o'},
+    {"serve", PARG_REQARG, NULL, 'v'},
+    {"loops", PARG_REQARG, NULL, 'j'},
+    {"keys", PARG_NOARG, NULL, 'k'},
+    {"3bv", PARG_NOARG, NULL, '3'},
+    {NULL, 0, NULL, 0}
+};
+
+int play(const Spec *, const char *, const char *, bool);
+int readCoords(Coord *, int, int, int, bool);
+int readCursor(Render *, const Board *, Coord *, int);
+void pan(Render *, const Board *, const Coord *);
+const char *undo(Journal *, const Coord *);
 
 
 int main(int argc, char **argv)
 {
-    srand(time(NULL));
-
-    /* width, height, mine probability - default values */
-    int w = 8, h = 8;
-    double mp = 0.16;
-    /* total fields, bombs, error variable */
-    int tot, bombs, flags, err;
-    /* fist iter? hit bomb? */
-    bool first, hitBomb;
-    /* struct to read and pass commands and coordinates */
-    Coord next;
+    /* width, height, mine probability, exact mines, seed - default values */
+    Spec spec = { .w = 8, .h = 8, .prob = 0.16, .mines = -1, .seed = time(NULL) };
+    /* headless script, NULL for stdin */
+    const char *batch = NULL;
+    bool batchMode = false, autoplay = false, keys = false;
+    /* number of games to simulate */
+    long simulate = 0;
+    /* saved game to resume and file to save to */
+    const char *load = NULL, *save = NULL;
+    /* socket to serve games on and number of event loops */
+    const char *serve = NULL;
+    int loops = 1;
+    /* size given on the command line */
+    bool sized = false;
 
     /* parsing argv */
     struct parg_state ps;
     int c;
     parg_init(&ps);
 
-    while ((c = parg_getopt(&ps, argc, argv, "w:h:p:")) != -1) {
+    while ((c = parg_getopt_long(&ps, argc, argv, "w:h:p:n:s:lget:", longopts, NULL)) != -1) {
         switch (c) {
             case 'w':
-                w = atoi(ps.optarg);
-                if (!(8 <= w && w <= 26)) {
-                    fputs("width must be in [8, 26] ...\n", stderr);
+                spec.w = atoi(ps.optarg);
+                sized = true;
+                break;
+            case 'h':
+                spec.h = atoi(ps.optarg);
+                sized = true;
+                break;
+            case 'p':
+                spec.prob = (double) atoi(ps.optarg) / 100.;
+                if (!(0 <= spec.prob && spec.prob <= 1)) {
+                    fputs("probability must be in [0, 100] (%) ...\n", stderr);
                     return EXIT_FAILURE;
                 }
                 break;
-            case 'h':
-                h = atoi(ps.optarg);
-                if (!(8 <= h && h <= 64)) {
-                    fputs("height must be in [8, 64] ...\n", stderr);
+            case 'n':
+                spec.mines = atol(ps.optarg);
+                if (spec.mines < 0) {
+                    fputs("number of mines must not be negative ...\n", stderr);
                     return EXIT_FAILURE;
                 }
                 break;
-            case 'p':
-                mp = (double) atoi(ps.optarg) / 100.;
-                if (!(0 <= mp && mp <= 1)) {
-                    fputs("probability must be in [0, 100] (%) ...\n", stderr);
+            case 's':
+                spec.seed = strtoull(ps.optarg, NULL, 0);
+                break;
+            case 'l':
+                spec.tiled = true;
+                break;
+            case 'g':
+                spec.noGuess = true;
+                break;
+            case 'e':
+                spec.lazy = true;
+                break;
+            case 't':
+                spec.topo = topologyByName(ps.optarg);
+                if (spec.topo < 0) {
+                    fputs("topology must be square, torus, hex or cross ...\n", stderr);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b':
+                batchMode = true;
+                batch = ps.optarg;
+                break;
+            case 'a':
+                autoplay = true;
+                break;
+            case 'm':
+                simulate = atol(ps.optarg);
+                if (simulate < 1) {
+                    fputs("number of games must be positive ...\n", stderr);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                load = ps.optarg;
+                break;
+            case 'o':
+                save = ps.optarg;
+                break;
+            case 'v':
+                serve = ps.optarg;
+                break;
+            case 'k':
+                keys = true;
+                break;
+            case '3':
+                spec.regions = true;
+                break;
+            case 'j':
+                loops = atoi(ps.optarg);
+                if (loops < 1) {
+                    fputs("number of loops must be positive ...\n", stderr);
                     return EXIT_FAILURE;
                 }
                 break;
@@ -96,293 +187,370 @@ int main(int argc, char **argv)
         }
     }
 
-    tot = w * h;
-
-    /* init field */
-    Field *field = malloc(tot * sizeof(*field));
-    if (!field) {
-        fprintf(stderr, "Failed to allocate memory!\n");
+    if (spec.lazy) {
+        if (spec.noGuess || autoplay || simulate) {
+            fputs("endless boards can only be played by hand ...\n", stderr);
+            return EXIT_FAILURE;
+        }
+        spec.tiled = true;
+        if (!sized)
+            spec.w = spec.h = LARGE_MAX;
+    }
+    /* the solver only knows the square grid */
+    if (spec.topo != TOPO_SQUARE && (spec.noGuess || autoplay || simulate)) {
+        fputs("only square boards can be solved ...\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if (!(8 <= spec.w && spec.w <= (spec.tiled ? LARGE_MAX : DENSE_MAX_W))) {
+        fprintf(stderr, "width must be in [8, %d] ...\n", spec.tiled ? LARGE_MAX : DENSE_MAX_W);
         return EXIT_FAILURE;
     }
-    /* use array of pointers to fields to store neighbours */
-    Field *iter = field, *end = field + tot;
-    while (iter != end) {
-        iter->nbs = malloc(8 * sizeof(field));
-        ++iter;
+    if (!(8 <= spec.h && spec.h <= (spec.tiled ? LARGE_MAX : DENSE_MAX_H))) {
+        fprintf(stderr, "height must be in [8, %d] ...\n", spec.tiled ? LARGE_MAX : DENSE_MAX_H);
+        return EXIT_FAILURE;
     }
+    if (spec.mines >= (long)spec.w * spec.h) {
+        fprintf(stderr, "number of mines must be below %ld ...\n", (long)spec.w * spec.h);
+        return EXIT_FAILURE;
+    }
+
+    /* generates no-guess boards and labels large ones */
+    if (spec.noGuess || (spec.tiled && spec.regions))
+        spec.pool = poolCreate(0);
+    STATS_INIT();
+
+    if (batchMode)
+        c = runBatch(batch, &spec);
+    else if (autoplay)
+        c = runAutoplay(&spec);
+    else if (simulate)
+        c = runSimulate(simulate, &spec);
+    else if (serve)
+        c = runServe(serve, loops, &spec);
+    else
+        c = play(&spec, load, save ? save : load ? load : SAVE_DEFAULT, keys);
+
+    poolDestroy(spec.pool);
+    return c;
+}
+
+
+/* interactive game on the terminal, resumed from load if given
+ * keys reads single keys moving a cursor instead of lines of commands */
+int play(const Spec *spec, const char *load, const char *save, bool keys)
+{
+    int w, h;
+    bool large;
+    /* fist iter? hit bomb? save or quit asked for? */
+    bool first, hitBomb, saving, quit;
+    /* commands of the last line and their number */
+    Coord cmds[CMDS_MAX];
+    int n, i, last;
+    Board board;
+    Regions regions;
+    Journal journal;
+    Render render;
+    /* undo or redo that found nothing to take back or make again */
+    const char *stuck;
+    /* status line and prompt of the next frame */
+    char status[128], prompt[256];
 
-    clear();
-    initFields(field, w, h, tot);
+    /* init field */
+    if (load) {
+        if ((n = loadFields(&board, load))) {
+            fprintf(stderr, n == -2 ? "%s: saved by another version\n"
+                    : "%s: not a saved game\n", load);
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        if (initFields(&board, spec->w, spec->h, spec->tiled)) {
+            fprintf(stderr, "Failed to allocate memory!\n");
+            return EXIT_FAILURE;
+        }
+        setTopology(&board, spec->topo);
+        seedFields(&board, spec->seed);
+    }
+    /* labelled if asked for, endless and too large boards are flooded */
+    memset(&regions, 0, sizeof(regions));
+    if (spec->regions && !spec->lazy)
+        regionsInit(&regions, &board, spec->pool);
+    journalInit(&journal, &board);
+    w = board.w;
+    h = board.h;
+    /* one character per field and numeric coordinates beyond the letters */
+    large = board.tiled || board.w > ALPHA_MAX;
+    renderInit(&render, STDOUT_FILENO, &board, large);
+    if (keys && termRaw(STDIN_FILENO, STDOUT_FILENO)) {
+        fprintf(stderr, "--keys needs a terminal, reading lines instead\n");
+        keys = false;
+    }
+    if (keys)
+        renderCursor(&render, &board, w / 2, h / 2);
 
     /* mainloop */
-    bombs = 0;
-    flags = 0;
-    first = true;
+    first = !board.armed;
     hitBomb = false;
-
-    printf("bombs unknown\n");
+    quit = false;
+
+    if (first)
+        snprintf(status, sizeof(status), "bombs unknown");
+    else
+        snprintf(status, sizeof(status), "%ld / %ld  - bombs / flags",
+                board.bombs, board.flags);
+    snprintf(prompt, sizeof(prompt), "%s",
+            keys ? PROMPT_KEYS : large ? PROMPT_LARGE : PROMPT);
     for(;;) {
-        printField(field, w, h);
-        err = readCoord(&next, w, h);
-        clear();
-
-        if (first) {
-            bombs = setBombs(field, field+tot, mp, w, &next);
-            first = false;
+        renderFrame(&render, &board, status, prompt);
+        if (keys)
+            n = readCursor(&render, &board, cmds, CMDS_MAX);
+        else
+            n = readCoords(cmds, CMDS_MAX, w, h, large);
+        STATS_POLL();
+
+        if (n == -3) {
+            snprintf(status, sizeof(status), "end of input");
+            break;
         }
-        if (err) {
-            printf("invalid input, try again...\n");
+        if (n < 0) {
+            /* interrupted reads leave the status as it is */
+            if (n != -2)
+                snprintf(status, sizeof(status), "invalid input, try again...");
             continue;
         }
 
-        hitBomb = step(field, &next, w, &flags);
+        /* the whole line is played before the next frame */
+        saving = false;
+        stuck = NULL;
+        for (last = -1, i = 0; i < n && !hitBomb && !allOpen(&board); ++i) {
+            if (cmds[i].c == 'S') {
+                saving = true;
+                continue;
+            }
+            if (cmds[i].c == 'Q') {
+                quit = true;
+                break;
+            }
+            if (strchr("HJKL", cmds[i].c)) {
+                pan(&render, &board, &cmds[i]);
+                continue;
+            }
+            if (cmds[i].c == 'U' || cmds[i].c == 'R') {
+                stuck = undo(&journal, &cmds[i]);
+                continue;
+            }
+            if (first) {
+                placeBombs(&board, spec, &cmds[i]);
+                first = false;
+            }
+            hitBomb = step(&board, &cmds[i]);
+            last = i;
+        }
+        /* keep the last move in view */
+        if (last >= 0)
+            renderFocus(&render, &board, cmds[last].x, cmds[last].y);
+        if (quit) {
+            snprintf(status, sizeof(status), "quit");
+            break;
+        }
         if (hitBomb) {
-            printf("you lost...\n");
+            snprintf(status, sizeof(status), "you lost...");
             break;
         }
-        if (allOpen(field, field+tot)) {
-            printf("you won!\n");
+        if (allOpen(&board)) {
+            snprintf(status, sizeof(status), "you won!");
             break;
         }
 
-        printf("%d / %d  - bombs / flags\n", bombs, flags);
+        if (stuck)
+            snprintf(status, sizeof(status), "%s", stuck);
+        else if (!saving)
+            snprintf(status, sizeof(status), "%ld / %ld  - bombs / flags",
+                    board.bombs, board.flags);
+        else if (saveFields(&board, save))
+            snprintf(status, sizeof(status), "could not save to %.100s", save);
+        else
+            snprintf(status, sizeof(status), "saved to %.100s", save);
     }
 
     /* game finished */
-    showMines(field, field+tot);
-    printField(field, w, h);
+    showMines(&board);
+    snprintf(prompt, sizeof(prompt), "seed %llu\n", (unsigned long long)board.seed);
+    renderFrame(&render, &board, status, prompt);
+    termRestore();
+    STATS_DUMP();
 
     /* cleanup */
-    iter = field;
-    while (iter != end) {
-        free(iter->nbs);
-        ++iter;
-    }
-    free(field);
+    renderFree(&render);
+    journalFree(&journal);
+    regionsFree(&regions);
+    freeFields(&board);
 
     return EXIT_SUCCESS;
 }
 
 
-/* set neighbour references of each field and init members */
-void initFields(Field *field, int w, int h, int tot)
+/* read one line of commands and coordinates from user input into cmds
+ * a lone s asks to save the game
+ * returns number of commands or errorcode, -2 if a signal interrupted the
+ * read, -3 at the end of input */
+int readCoords(Coord *cmds, int max, int w, int h, bool numeric)
 {
-    int i;
-
-    /* iterate over all cells, set neighbours and bombs */
-    for (i = 0; i < tot; ++i) {
-        field[i].nbs[0] = &field[i-w];      /* u  */
-        field[i].nbs[1] = &field[i-w+1];    /* ur */
-        field[i].nbs[2] = &field[i+1];      /* r  */
-        field[i].nbs[3] = &field[i+w+1];    /* dr */
-        field[i].nbs[4] = &field[i+w];      /* d  */
-        field[i].nbs[5] = &field[i+w-1];    /* dl */
-        field[i].nbs[6] = &field[i-1];      /* l  */
-        field[i].nbs[7] = &field[i-w-1];    /* ul */
-
-        field[i].isOpen     = false;
-        field[i].flag       = false;
-        /* field[i].hasBomb    = rand_one(prob);
-         * if (field[i].hasBomb)
-         *     ++bombs; */
-    }
-
-    /* UGLY HACK - set corner cases */
-    /* upmost and downmost row */
-    for (i = 0; i < w; ++i) {
-        field[i].nbs[0] = NULL;             /* u  */
-        field[i].nbs[1] = NULL;             /* ur */
-        field[i].nbs[7] = NULL;             /* ul */
-        field[i+w*(h-1)].nbs[4] = NULL;     /* d  */
-        field[i+w*(h-1)].nbs[3] = NULL;     /* dr */
-        field[i+w*(h-1)].nbs[5] = NULL;     /* dl */
+    int err, c, n, len;
+    int x, y;
+    char cmd, xalpha, line[1024], *p;
+    STAT_CLOCK(start);
+
+    if (!fgets(line, sizeof(line), stdin)) {
+        STAT_SINCE(inputNs, start);
+        if (ferror(stdin) && errno == EINTR) {
+            clearerr(stdin);
+            return -2;
+        }
+        return feof(stdin) ? -3 : -1;
     }
-
-    /* leftmost and rightmost column */
-    for (i = 0; i < tot; i+=w) {
-        field[i].nbs[6] = NULL;             /* l  */
-        field[i].nbs[7] = NULL;             /* ul */
-        field[i].nbs[5] = NULL;             /* dl */
-        field[i+w-1].nbs[2] = NULL;         /* r  */
-        field[i+w-1].nbs[1] = NULL;         /* ur */
-        field[i+w-1].nbs[3] = NULL;         /* dr */
+    /* clear stdin */
+    if (!strchr(line, '\n'))
+        while ((c = getchar()) != '\n' && c != EOF);
+    STAT_ADD(inputs, 1);
+    STAT_SINCE(inputNs, start);
+
+    if (sscanf(line, " %c %c", &cmd, &xalpha) == 1 && toupper(cmd) == 'S') {
+        cmds[0].c = 'S';
+        return 1;
     }
 
-}
-
-
-/* randomly distribute bombs
- * make sure, the first uncovered field is empty */
-int setBombs(Field *field, Field *end, double prob, int w, Coord *init)
-{
-    int bombs, i;
-    Field *iter, *first;
-
-    bombs = 0;
-    iter = field - 1;
-    first = field + init->x + w * init->y;
-    while(iter != end) {
-        ++iter;
-        if (iter == first)
+    /* commands follow each other, separated by blanks */
+    for (n = 0, p = line + strspn(line, " \t\n"); *p; p += strspn(p, " \t\n")) {
+        if (n == max)
+            return -1;
+        cmd = toupper(*p);
+        if (cmd == 'H' || cmd == 'J' || cmd == 'K' || cmd == 'L'
+                || cmd == 'U' || cmd == 'R') {
+            /* scrolling by an optional number of fields, undo and redo by
+             * an optional number of moves */
+            ++p;
+            x = 0;
+            if (sscanf(p, "%d%n", &x, &len) == 1) {
+                if (x <= 0)
+                    return -1;
+                p += len;
+            }
+            cmds[n].x = x;
+            cmds[n].y = 0;
+            cmds[n].c = cmd;
+            ++n;
             continue;
-        iter->hasBomb = rand_one(prob);
-        if (iter->hasBomb)
-            ++bombs;
-    }
+        }
+
+        x = -1;
+        if (numeric) {
+            err = sscanf(p, "%c%d%d%n", &cmd, &x, &y, &len);
+            err = (err == 3) ? 0 : -1;
+        }
+        else {
+            err = sscanf(p, "%c%c%d%n", &cmd, &xalpha, &y, &len);
+            err = (err == 3) ? 0 : -1;
+            xalpha = toupper(xalpha);
+            for (x = 0; x < ALPHA_MAX; ++x)
+                if (AZ[x] == xalpha)
+                    break;
+        }
 
-    /* iterate over all fields and set neighbouring bombs */
-    iter = field;
-    while (iter != end) {
-        iter->nb = 0;
-        for (i = 0; i < 8; ++i)
-            iter->nb += ((iter->nbs[i] != NULL && iter->nbs[i]->hasBomb) ? 1 : 0);
-        ++iter;
+        cmd = toupper(cmd);
+        if (err || x < 0 || y < 0 || x >= w || y >= h \
+                || !(cmd == 'C' || cmd == 'F' || cmd == 'O'))
+            return -1;
+        cmds[n].x = x;
+        cmds[n].y = y;
+        cmds[n].c = cmd;
+        ++n;
+        p += len;
     }
 
-    return bombs;
+    return n ? n : -1;
 }
 
 
-/* format and print field array to console */
-void printField(Field *field, int w, int h)
+/* turn the keys typed so far into commands at the cursor, moving it on
+ * the way
+ * returns number of commands or errorcode as readCoords */
+int readCursor(Render *r, const Board *b, Coord *cmds, int max)
 {
-    Field *cur;
-    int i, j;
-    printf("   ");
-    for (i = 0; i < w; ++i)
-        printf("  %c %s", AZ[i], (i == w-1) ? "\n" : "");
-    for (i = 0; i < h; ++i) {
-        printf("   ");
-        for (j = 0; j < w; ++j)
-            printf("|---%s", (j == w-1) ? "|\n" : "");
-        printf("%s%d ", (i >= 10) ? "" : " ", i);
-        for (j = 0; j < w; ++j) {
-            cur = &field[w*i+j];
-            if (cur->isOpen && cur->hasBomb)
-                printf("| " BOLD "X" RESET " ");
-            else if (cur->isOpen)
-                printf("| " BOLD "%s" "%d" RESET " ", colors[cur->nb], cur->nb);
-            else if (cur->flag)
-                printf("|" BOLD RED "<F>" RESET);
-            else
-                printf("|   ");
+    int keys[CMDS_MAX];
+    int x = r->cx, y = r->cy, i, n, k;
+
+    k = readKeys(keys, max < CMDS_MAX ? max : CMDS_MAX);
+    if (k < 0)
+        return k;
+    for (n = 0, i = 0; i < k; ++i) {
+        switch (keys[i]) {
+            case KEY_LEFT: case 'h':
+                x -= x > 0;
+                break;
+            case KEY_RIGHT: case 'l':
+                x += x < b->w - 1;
+                break;
+            case KEY_UP: case 'k':
+                y -= y > 0;
+                break;
+            case KEY_DOWN: case 'j':
+                y += y < b->h - 1;
+                break;
+            case ' ': case '\r': case 'c':
+                cmds[n++] = (Coord){ x, y, testBit(b, OPEN, x, y) ? 'O' : 'C' };
+                break;
+            case 'f': case 'o': case 's': case 'q':
+                cmds[n++] = (Coord){ x, y, toupper(keys[i]) };
+                break;
+            case 'u': case 'r':
+                cmds[n++] = (Coord){ 1, 0, toupper(keys[i]) };
+                break;
+            case 3:     /* ctrl-c */
+                cmds[n++] = (Coord){ x, y, 'Q' };
+                break;
         }
-        printf("|\n");
     }
-    printf("   ");
-    for (j = 0; j < w; ++j)
-        printf("|---%s", (j == w-1) ? "|\n" : "");
+    renderCursor(r, b, x, y);
+    return n;
 }
 
 
-/* read command and coordinates from user input into Coord struct
- * returns errorcode */
-int readCoord(Coord *next, int w, int h)
+/* move the view by a scroll command, by its count or half a screen */
+void pan(Render *r, const Board *b, const Coord *c)
 {
-    int err, c;
-    int x, y;
-    char cmd, xalpha;
+    int dx = c->x ? c->x : r->vw > 1 ? r->vw / 2 : 1;
+    int dy = c->x ? c->x : r->vh > 1 ? r->vh / 2 : 1;
 
-    printf("Enter command (c - uncover, f - flag) and coordinate (a-z, 0-xx): ");
-    err = scanf("%c%c%d", &cmd, &xalpha, &y);
-    /* clear stdin */
-    while ((c = getchar()) != '\n' && c != EOF);
-
-    cmd = toupper(cmd);
-    xalpha = toupper(xalpha);
-    for (x = 0; x < 26; ++x)
-        if (AZ[x] == xalpha)
+    switch (c->c) {
+        case 'H':
+            renderPan(r, b, -dx, 0);
+            break;
+        case 'L':
+            renderPan(r, b, dx, 0);
+            break;
+        case 'K':
+            renderPan(r, b, 0, -dy);
+            break;
+        case 'J':
+            renderPan(r, b, 0, dy);
             break;
-    if (err != 3 || x == 26 || x >= w || y >= h \
-            || !(cmd == 'C' || cmd == 'F'))
-        return -1;
-    next->x = x;
-    next->y = y;
-    next->c = cmd;
-
-    return 0;
-}
-
-
-/* check if all fields are either uncovered or have a bomb
- * in that case the game is won */
-bool allOpen(Field *field, Field *end)
-{
-    while (field != end) {
-        if (!(field->isOpen || field->hasBomb))
-            return false;
-        ++field;
-    }
-    return true;
-}
-
-
-/* perform given command (uncover, flag) on given coordinates */
-bool step(Field *field, Coord *next, int w, int *flags)
-{
-    field += (next->x + w * next->y);
-
-    if (next->c == 'C') {
-        *flags += field->flag ? -1 : 0;
-        if (field->hasBomb)
-            return true;
-        else if (!field->isOpen)
-            openFields(field);
-    }
-    else if (next->c == 'F' && !field->isOpen) {
-        field->flag = !field->flag;
-        *flags += field->flag ? 1 : -1;
     }
-
-    return false;
 }
 
 
-/* uncover all bombs when the game is finished */
-void showMines(Field *field, Field *end)
+/* take back or make again as many moves as the command asks for, one
+ * without a count
+ * returns message if there were fewer, else NULL */
+const char *undo(Journal *j, const Coord *c)
 {
-    while (field != end) {
-        if (field->hasBomb)
-            field->isOpen = true;
-        ++field;
-    }
-}
-
+    int n = c->x ? c->x : 1;
 
-/* recusivly open fields which do not neighbour to a bomb */
-void openFields(Field *field)
-{
-    field->isOpen = true;
-
-    int i;
-    for (i = 0; i < 8; ++i) {
-        if (!(field->nbs[i] == NULL         \
-                || field->nbs[i]->hasBomb   \
-                || field->nbs[i]->isOpen    \
-                || field->nbs[i]->flag))
-        {
-            if (field->nbs[i]->nb == 0)
-                openFields(field->nbs[i]);
-            else
-                field->nbs[i]->isOpen = true;
-        }
+    while (n--) {
+        if (c->c == 'U' && !journalUndo(j))
+            return "nothing to undo";
+        if (c->c == 'R' && !journalRedo(j))
+            return "nothing to redo";
     }
-}
-
-
-/* returns 1 with given probability
- * else returns 0 */
-int rand_one(double prob)
-{
-    return (rand() < prob * ((double)RAND_MAX + 1.0)) ? 1 : 0;
-}
-
-
-/* clear console window */
-/* solutions for windows and unix */
-void clear()
-{
-#if !DEBUG
-    puts("\x1B[2J\x1B[H");
-#endif
+    return NULL;
 }
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+
+/* neighbour counting on whole rows
+ *
+ * the mine words of a tile are copied into a padded scratch grid, stored
+ * column by column so that consecutive rows are adjacent in memory. for
+ * every row word the eight neighbours are the rows above and below shifted
+ * by one bit, which a carry save adder sums into four bit slices. the
+ * kernel handles 1, 2 or 4 rows at once, picked at runtime. boards of
+ * other topologies add up the shifted rows of their offset table instead.
+ * the halo of wrapping boards is taken from the opposite edges. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86 1
+#else
+#define HAVE_X86 0
+#endif
+
+/* scratch rows above, below and for the vector tail */
+#define PAD 6
+
+typedef uint64_t v2u64 __attribute__((vector_size(16)));
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+typedef void (*Kernel)(const uint64_t *, const uint64_t *, const uint64_t *,
+        int, uint64_t **);
+
+static Kernel kernel;
+
+/* bit i goes to bit 4*i, spreads 8 cells into 4 bytes of nibbles */
+static uint32_t spread[256];
+
+static _Thread_local uint64_t *scratch;
+static _Thread_local size_t scratchSize;
+
+
+/* sum the 8 neighbours of rows [0, rows) of column c into slices s[0..3]
+ * l and r are the columns left and right of c */
+#define SLICE_KERNEL(name, V, N, attr)                                      \
+attr static void name(const uint64_t *c, const uint64_t *l,                 \
+        const uint64_t *r, int rows, uint64_t **s)                          \
+{                                                                           \
+    V u, m, d, lu, lm, ld, ru, rm, rd;                                      \
+    V i0, i1, i2, i3, i4, i5, i6, i7;                                       \
+    V s1, c1, s2, c2, s3, c3, c4, t, c5, c6;                                \
+    int y;                                                                  \
+                                                                            \
+    for (y = 0; y < rows; y += N) {                                         \
+        memcpy(&u, c + y - 1, sizeof(V));                                   \
+        memcpy(&m, c + y, sizeof(V));                                       \
+        memcpy(&d, c + y + 1, sizeof(V));                                   \
+        memcpy(&lu, l + y - 1, sizeof(V));                                  \
+        memcpy(&lm, l + y, sizeof(V));                                      \
+        memcpy(&ld, l + y + 1, sizeof(V));                                  \
+        memcpy(&ru, r + y - 1, sizeof(V));                                  \
+        memcpy(&rm, r + y, sizeof(V));                                      \
+        memcpy(&rd, r + y + 1, sizeof(V));                                  \
+                                                                            \
+        i0 = (u << 1) | (lu >> 63);                                         \
+        i1 = u;                                                             \
+        i2 = (u >> 1) | (ru << 63);                                         \
+        i3 = (m << 1) | (lm >> 63);                                         \
+        i4 = (m >> 1) | (rm << 63);                                         \
+        i5 = (d << 1) | (ld >> 63);                                         \
+        i6 = d;                                                             \
+        i7 = (d >> 1) | (rd << 63);                                         \
+                                                                            \
+        /* full adders down to one bit per weight */                        \
+        s1 = i0 ^ i1 ^ i2;                                                  \
+        c1 = (i0 & i1) | (i2 & (i0 ^ i1));                                  \
+        s2 = i3 ^ i4 ^ i5;                                                  \
+        c2 = (i3 & i4) | (i5 & (i3 ^ i4));                                  \
+        s3 = i6 ^ i7;                                                       \
+        c3 = i6 & i7;                                                       \
+        c4 = (s1 & s2) | (s3 & (s1 ^ s2));                                  \
+        t  = c1 ^ c2 ^ c3;                                                  \
+        c5 = (c1 & c2) | (c3 & (c1 ^ c2));                                  \
+        c6 = t & c4;                                                        \
+                                                                            \
+        s1 = s1 ^ s2 ^ s3;                                                  \
+        memcpy(s[0] + y, &s1, sizeof(V));                                   \
+        t = t ^ c4;                                                         \
+        memcpy(s[1] + y, &t, sizeof(V));                                    \
+        t = c5 ^ c6;                                                        \
+        memcpy(s[2] + y, &t, sizeof(V));                                    \
+        t = c5 & c6;                                                        \
+        memcpy(s[3] + y, &t, sizeof(V));                                    \
+    }                                                                       \
+}
+
+SLICE_KERNEL(sliceScalar, uint64_t, 1, )
+#if HAVE_X86
+SLICE_KERNEL(sliceSse2, v2u64, 2, __attribute__((target("sse2"))))
+SLICE_KERNEL(sliceAvx2, v4u64, 4, __attribute__((target("avx2"))))
+#endif
+
+
+/* sum the neighbours given by the offset table of tp for rows [0, rows)
+ * of column c, the first of them is row y0 of the board */
+static void sliceTable(const Topology *tp, int y0, const uint64_t *c,
+        const uint64_t *l, const uint64_t *r, int rows, uint64_t **s)
+{
+    uint64_t s0, s1, s2, s3, v, carry;
+    int y, i, j, dx;
+
+    for (y = 0; y < rows; ++y) {
+        s0 = s1 = s2 = s3 = 0;
+        for (i = 0; i < tp->n; ++i) {
+            dx = tp->dx[(y0 + y) & 1][i];
+            j = y + tp->dy[(y0 + y) & 1][i];
+            v = dx < 0 ? c[j] << 1 | l[j] >> 63 : dx > 0 ? c[j] >> 1 | r[j] << 63 : c[j];
+            /* ripple the bit through the slices */
+            carry = s0 & v;
+            s0 ^= v;
+            v = s1 & carry;
+            s1 ^= carry;
+            carry = s2 & v;
+            s2 ^= v;
+            s3 ^= carry;
+        }
+        s[0][y] = s0;
+        s[1][y] = s1;
+        s[2][y] = s2;
+        s[3][y] = s3;
+    }
+}
+
+
+/* pick the widest kernel the cpu supports */
+__attribute__((constructor)) static void selectKernel(void)
+{
+    int i, j;
+
+    for (i = 0; i < 256; ++i)
+        for (spread[i] = 0, j = 0; j < 8; ++j)
+            spread[i] |= (uint32_t)(i >> j & 1) << 4*j;
+
+#if HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernel = sliceAvx2;
+    else if (__builtin_cpu_supports("sse2"))
+        kernel = sliceSse2;
+    else
+#endif
+        kernel = sliceScalar;
+}
+
+
+/* mine word of cells x...x+63 in row y, x a multiple of 64
+ * rows of wrapping boards continue on the other side */
+static uint64_t mineWord(const Board *b, long x, int y)
+{
+    Tile *t;
+
+    if (b->topo->wrap)
+        y += y < 0 ? b->h : y >= b->h ? -b->h : 0;
+    if (y < 0 || y >= b->h || x < 0 || x >= b->w)
+        return 0;
+    t = tileAt(b, x, y);
+    if (t)
+        return *tileWord(b, t, MINE, x, y);
+    /* tiles of endless boards not reached yet still have bombs */
+    return b->lazy ? lazyWord(b, x, y) : 0;
+}
+
+
+/* put the fields left of the first and right of the last column of a
+ * wrapping board into the halo of a tile at its edge
+ * the rows are those loaded by mineWord */
+static void wrapColumns(const Board *b, uint64_t *cols0, int stride,
+        long x0, int y0, int cols, int rows)
+{
+    uint64_t *col;
+    int y, gy;
+
+    for (y = -1; y <= rows; ++y) {
+        gy = y0 + y < 0 ? b->h - 1 : y0 + y >= b->h ? 0 : y0 + y;
+        if (x0 == 0)
+            cols0[y] |= (uint64_t)testBit(b, MINE, b->w - 1, gy) << 63;
+        if (x0 + cols == b->w) {
+            col = cols0 + (long)((cols >> 6) + 1) * stride;
+            col[y] |= (uint64_t)testBit(b, MINE, 0, gy) << (cols & 63);
+        }
+    }
+}
+
+
+/* count neighbouring bombs of every cell in the tile at tx, ty */
+void countTile(Board *b, Tile *t, int tx, int ty)
+{
+    uint64_t *col, *s[4], mask, v = 0;
+    uint8_t *nb = tileNbPlane(b, t), *dst;
+    long x0 = (long)tx << b->tshift;
+    int y0 = ty << b->tshift;
+    int cols, rows, stride, k, y, j, n;
+    size_t need;
+
+    if (b->engine) {
+        b->engine->count(b, t);
+        return;
+    }
+    cols = b->w - x0 < b->tw ? b->w - x0 : b->tw;
+    rows = b->h - y0 < b->th ? b->h - y0 : b->th;
+    stride = rows + PAD;
+
+    /* rw + 2 mine columns and 4 slices, one guard row on top */
+    need = (size_t)(b->rw + 6) * stride;
+    if (need > scratchSize) {
+        free(scratch);
+        scratch = malloc(need * sizeof(*scratch));
+        scratchSize = scratch ? need : 0;
+        if (!scratch) {
+            fprintf(stderr, "Failed to allocate memory!\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* column k lives at scratch + (k+1)*stride + 1, halo from neighbours */
+    for (k = -1; k <= b->rw; ++k) {
+        col = scratch + (long)(k + 1) * stride + 1;
+        for (y = -1; y < stride - 1; ++y)
+            col[y] = y <= rows ? mineWord(b, x0 + 64L*k, y0 + y) : 0;
+    }
+    if (b->topo->wrap)
+        wrapColumns(b, scratch + 1, stride, x0, y0, cols, rows);
+    for (j = 0; j < 4; ++j)
+        s[j] = scratch + (long)(b->rw + 2 + j) * stride + 1;
+
+    for (k = 0; k < b->rw; ++k) {
+        col = scratch + (long)(k + 1) * stride + 1;
+        if (b->topo->box)
+            kernel(col, col - stride, col + stride, rows, s);
+        else
+            sliceTable(b->topo, y0, col, col - stride, col + stride, rows, s);
+
+        n = cols - 64*k;
+        mask = n >= 64 ? ~0ULL : (1ULL << n) - 1;
+        n = n >= 64 ? 32 : (n + 1) / 2;     /* nb bytes of this word */
+        for (y = 0; y < rows; ++y) {
+            dst = nb + (long)y * b->ns + 32*k;
+            for (j = 0; j < n; ++j) {
+                /* four cells per two bytes, spread one byte of each slice */
+                if (!(j & 3)) {
+                    v = spread[(s[0][y] & mask) >> 2*j & 0xff]
+                        | spread[(s[1][y] & mask) >> 2*j & 0xff] << 1
+                        | spread[(s[2][y] & mask) >> 2*j & 0xff] << 2
+                        | spread[(s[3][y] & mask) >> 2*j & 0xff] << 3;
+                }
+                dst[j] = v >> 8*(j & 3);
+            }
+        }
+    }
+    t->nbReady = true;
+}
@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include "board.h"
+#include "solver.h"
+
+/* boards solvable without guessing
+ *
+ * candidates are numbered, candidate i is generated from seed + i and
+ * handed out to the workers of the pool in rounds. a candidate the solver
+ * gets stuck on is repaired by moving a bomb next to the open area to a
+ * field away from it, then solved again from the first click. the lowest
+ * numbered solvable candidate wins, so the result does not depend on the
+ * number of threads, and candidates above it are abandoned. */
+
+/* repairs of a single candidate before it is given up */
+#define REPAIRS     256
+/* candidates per worker and round */
+#define PER_ROUND   4
+/* give up after this many candidates and place bombs as usual */
+#define MAX_CANDS   4096
+
+/* board and solver of a worker, reused across candidates */
+typedef struct Cand {
+    Board board;
+    Solver solver;
+    bool ready;
+    long index;         /* solvable candidate held by the board, -1 if none */
+} __attribute__((aligned(64))) Cand;
+
+typedef struct Gen {
+    Spec spec;          /* plain placement */
+    Coord init;
+    uint64_t seed;
+    long found;         /* lowest solvable candidate so far */
+    long round;         /* first candidate of the round */
+    Cand *cands;
+    bool failed;
+} Gen;
+
+
+static bool abandoned(Gen *g, long i)
+{
+    return __atomic_load_n(&g->found, __ATOMIC_RELAXED) < i;
+}
+
+
+static bool nearOpen(const Board *b, int x, int y)
+{
+    int i;
+    Cell c;
+
+    for (i = 0; i < b->topo->n; ++i)
+        if (neighbour(b, x, y, i, &c) && testBit(b, OPEN, c.x, c.y))
+            return true;
+    return false;
+}
+
+
+/* move a bomb off the border of the open area
+ * returns false if there is no bomb to move or no place to move it to */
+static bool repair(Board *b)
+{
+    long i, k, n = 0, pick;
+    int x, y, fx = -1, fy = -1;
+
+    /* reservoir sampling of a covered bomb next to an open field */
+    for (i = 0; i < b->tot; ++i) {
+        x = i % b->w;
+        y = i / b->w;
+        if (testBit(b, MINE, x, y) && !testBit(b, OPEN, x, y) && nearOpen(b, x, y)
+                && rngBelow(&b->rng, ++n) == 0) {
+            fx = x;
+            fy = y;
+        }
+    }
+    if (!n)
+        return false;
+
+    /* covered free field away from the open area, by trial first */
+    for (k = 0; k < 64; ++k) {
+        i = rngBelow(&b->rng, b->tot);
+        x = i % b->w;
+        y = i / b->w;
+        if (!testBit(b, MINE, x, y) && !testBit(b, OPEN, x, y) && !nearOpen(b, x, y)) {
+            moveBomb(b, fx, fy, x, y);
+            return true;
+        }
+    }
+    pick = -1;
+    for (n = 0, i = 0; i < b->tot; ++i) {
+        x = i % b->w;
+        y = i / b->w;
+        if (!testBit(b, MINE, x, y) && !testBit(b, OPEN, x, y) && !nearOpen(b, x, y)
+                && rngBelow(&b->rng, ++n) == 0)
+            pick = i;
+    }
+    if (pick < 0)
+        return false;
+    moveBomb(b, fx, fy, pick % b->w, pick / b->w);
+    return true;
+}
+
+
+/* generate candidate round + i and repair it until the solver clears it */
+static void tryCand(void *arg, long i, int worker)
+{
+    Gen *g = arg;
+    Cand *c = &g->cands[worker];
+    Board *b = &c->board;
+    Coord first;
+    long cur;
+    int r;
+
+    i += g->round;
+    if (abandoned(g, i) || c->index >= 0)
+        return;
+    if (!c->ready) {
+        if (initFields(b, g->spec.w, g->spec.h, g->spec.tiled)
+                || solverInit(&c->solver, b)) {
+            g->failed = true;
+            return;
+        }
+        c->ready = true;
+    }
+
+    resetFields(b, g->seed + i);
+    first = g->init;
+    placeBombs(b, &g->spec, &first);
+
+    for (r = 0; r <= REPAIRS && !abandoned(g, i); ++r) {
+        if (r) {
+            if (!repair(b))
+                return;
+            coverFields(b);
+        }
+        solverReset(&c->solver);
+        first = g->init;
+        step(b, &first);
+        if (solve(&c->solver) >= 0 && allOpen(b)) {
+            c->index = i;
+            /* lower the bar for everyone still working */
+            cur = __atomic_load_n(&g->found, __ATOMIC_RELAXED);
+            while (i < cur && !__atomic_compare_exchange_n(&g->found, &cur, i,
+                        false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+            return;
+        }
+    }
+}
+
+
+/* distribute bombs such that the board can be cleared from the first
+ * uncovered field without guessing, candidates are tested on the pool of
+ * the settings
+ * falls back to the usual placement if no such board is found */
+long placeNoGuess(Board *b, const Spec *s, Coord *init)
+{
+    Gen g;
+    int n = poolSize(s->pool), k;
+    long bombs = -1;
+
+    g.spec = *s;
+    g.spec.noGuess = false;
+    g.init = *init;
+    g.init.c = 'C';
+    g.seed = rngNext(&b->rng);
+    g.found = LONG_MAX;
+    g.failed = false;
+    g.cands = aligned_alloc(64, n * sizeof(*g.cands));
+    if (!g.cands) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    for (k = 0; k < n; ++k) {
+        g.cands[k].ready = false;
+        g.cands[k].index = -1;
+    }
+
+    for (g.round = 0; g.found == LONG_MAX && !g.failed && g.round < MAX_CANDS;
+            g.round += (long)n * PER_ROUND)
+        poolRun(s->pool, tryCand, &g, (long)n * PER_ROUND);
+
+    for (k = 0; k < n; ++k) {
+        if (g.cands[k].index >= 0 && g.cands[k].index == g.found)
+            bombs = copyBombs(b, &g.cands[k].board);
+        if (g.cands[k].ready) {
+            solverFree(&g.cands[k].solver);
+            freeFields(&g.cands[k].board);
+        }
+    }
+    free(g.cands);
+
+    if (g.failed) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        exit(EXIT_FAILURE);
+    }
+    return bombs < 0 ? placeBombs(b, &g.spec, init) : bombs;
+}
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+struct Pool {
+    int n;              /* workers including the caller */
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    unsigned long gen;  /* bumped for every run */
+    int busy;           /* threads still working on this run */
+    bool quit;
+    Job job;
+    void *arg;
+    long count;
+    long next;          /* next index to hand out */
+};
+
+typedef struct Worker {
+    Pool *p;
+    int id;
+} Worker;
+
+
+static void work(Pool *p, int id)
+{
+    long i;
+
+    while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) < p->count)
+        p->job(p->arg, i, id);
+}
+
+
+static void *loop(void *arg)
+{
+    Pool *p = ((Worker *)arg)->p;
+    int id = ((Worker *)arg)->id;
+    unsigned long gen = 0;
+
+    free(arg);
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->gen == gen && !p->quit)
+            pthread_cond_wait(&p->wake, &p->lock);
+        if (p->quit)
+            break;
+        gen = p->gen;
+        pthread_mutex_unlock(&p->lock);
+
+        work(p, id);
+
+        pthread_mutex_lock(&p->lock);
+        if (--p->busy == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+
+/* start n - 1 threads, n < 1 uses all cpus
+ * returns NULL on failure */
+Pool *poolCreate(int n)
+{
+    Pool *p;
+    Worker *w;
+
+    if (n < 1)
+        n = cpuCount();
+    p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->threads = malloc(n * sizeof(*p->threads));
+    if (!p->threads) {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for (p->n = 1; p->n < n; ++p->n) {
+        w = malloc(sizeof(*w));
+        if (!w)
+            break;
+        w->p = p;
+        w->id = p->n;
+        if (pthread_create(&p->threads[p->n], NULL, loop, w)) {
+            free(w);
+            break;
+        }
+    }
+    return p;
+}
+
+
+void poolDestroy(Pool *p)
+{
+    int i;
+
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->quit = true;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 1; i < p->n; ++i)
+        pthread_join(p->threads[i], NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->done);
+    free(p->threads);
+    free(p);
+}
+
+
+int poolSize(const Pool *p)
+{
+    return p ? p->n : 1;
+}
+
+
+/* run job for every index in [0, count), returns once all are done */
+void poolRun(Pool *p, Job job, void *arg, long count)
+{
+    long i;
+
+    if (!p || p->n == 1 || count == 1) {
+        for (i = 0; i < count; ++i)
+            job(arg, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->job = job;
+    p->arg = arg;
+    p->count = count;
+    p->next = 0;
+    p->busy = p->n - 1;
+    ++p->gen;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+
+    work(p, 0);
+
+    pthread_mutex_lock(&p->lock);
+    while (p->busy)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+
+int cpuCount(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
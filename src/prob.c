@@ -0,0 +1,679 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "prob.h"
+
+/* components with more fields are estimated right away */
+#define MAX_VARS 1024
+
+/* open number and the frontier fields around it */
+typedef struct Con {
+    int value;          /* bombs still missing */
+    int n;
+    long var[8];        /* field index, later frontier id */
+} Con;
+
+/* independent part of the frontier */
+typedef struct Comp {
+    int n;              /* fields */
+    int *vars;          /* frontier ids */
+    int ncons;
+    Con **cons;
+    bool exact;
+    double *cnt;        /* configurations by number of bombs, n + 1 */
+    double *cell;       /* per field and number of bombs, n * (n + 1),
+                           enumerated components only */
+    double *dens;       /* per field bomb probability, estimated only */
+} Comp;
+
+/* search state of one component */
+typedef struct Enum {
+    Comp *c;
+    int *order;         /* local field ids in search order */
+    int *vcStart, *vcList;  /* constraints of every local field */
+    int *sum, *left;    /* per constraint: bombs set, fields unset */
+    char *val;
+    int mines;
+    long nodes;
+} Enum;
+
+typedef struct Work {
+    Comp *comps;
+    int *byId;          /* frontier id to local id within its component */
+} Work;
+
+
+static void noMem(void)
+{
+    fprintf(stderr, "Failed to allocate memory!\n");
+    exit(EXIT_FAILURE);
+}
+
+static void *xmalloc(size_t n)
+{
+    void *p = malloc(n ? n : 1);
+    if (!p)
+        noMem();
+    return p;
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p = calloc(n ? n : 1, size);
+    if (!p)
+        noMem();
+    return p;
+}
+
+static int cmpLong(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/* log of n choose k, lgamma itself is not thread safe */
+static double lchoose(long n, long k)
+{
+    int sign;
+
+    return lgamma_r(n + 1., &sign) - lgamma_r(k + 1., &sign) - lgamma_r(n - k + 1., &sign);
+}
+
+
+static int findRoot(int *parent, int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+
+void probInit(Prob *p, Board *b, Pool *pool)
+{
+    memset(p, 0, sizeof(*p));
+    p->b = b;
+    p->pool = pool;
+}
+
+
+void probFree(Prob *p)
+{
+    free(p->front);
+    free(p->p);
+    p->front = NULL;
+    p->p = NULL;
+    p->nfront = 0;
+}
+
+
+/* set local field v of the search to x
+ * returns false if a constraint can no longer be met */
+static bool assign(Enum *e, int v, int x)
+{
+    Comp *c = e->c;
+    bool ok = true;
+    int k, j;
+
+    e->val[v] = x;
+    e->mines += x;
+    for (k = e->vcStart[v]; k < e->vcStart[v+1]; ++k) {
+        j = e->vcList[k];
+        e->sum[j] += x;
+        --e->left[j];
+        if (e->sum[j] > c->cons[j]->value || e->sum[j] + e->left[j] < c->cons[j]->value)
+            ok = false;
+    }
+    return ok;
+}
+
+static void unassign(Enum *e, int v, int x)
+{
+    int k;
+
+    e->mines -= x;
+    for (k = e->vcStart[v]; k < e->vcStart[v+1]; ++k) {
+        e->sum[e->vcList[k]] -= x;
+        ++e->left[e->vcList[k]];
+    }
+}
+
+/* backtracking over all fields of the component, counting configurations
+ * by their number of bombs */
+static void search(Enum *e, int d)
+{
+    Comp *c = e->c;
+    int v, x;
+
+    if (++e->nodes > PROB_BUDGET) {
+        c->exact = false;
+        return;
+    }
+    if (d == c->n) {
+        c->cnt[e->mines] += 1;
+        for (v = 0; v < c->n; ++v)
+            if (e->val[v])
+                c->cell[(long)v * (c->n + 1) + e->mines] += 1;
+        return;
+    }
+    v = e->order[d];
+    for (x = 0; x <= 1 && c->exact; ++x) {
+        if (assign(e, v, x))
+            search(e, d + 1);
+        unassign(e, v, x);
+    }
+}
+
+
+/* rough estimate for components too large to enumerate: every field gets
+ * the mean density of its constraints, the bomb count is their sum */
+static void estimate(Comp *c, const int *byId)
+{
+    double *dens = xcalloc(c->n, sizeof(*dens));
+    int *seen = xcalloc(c->n, sizeof(*seen));
+    double total = 0;
+    int i, k, v;
+
+    for (i = 0; i < c->ncons; ++i) {
+        for (k = 0; k < c->cons[i]->n; ++k) {
+            v = byId[c->cons[i]->var[k]];
+            dens[v] += (double)c->cons[i]->value / c->cons[i]->n;
+            ++seen[v];
+        }
+    }
+    for (v = 0; v < c->n; ++v)
+        total += dens[v] /= seen[v];
+
+    /* the table of a search over budget is not needed any more */
+    free(c->cell);
+    c->cell = NULL;
+    c->dens = dens;
+    memset(c->cnt, 0, (c->n + 1) * sizeof(*c->cnt));
+    c->cnt[lround(total)] = 1;
+
+    free(seen);
+}
+
+
+/* enumerate one component, run on the pool */
+static void enumerate(void *arg, long i, int worker)
+{
+    Work *job = arg;
+    Comp *c = &job->comps[i];
+    Enum e;
+    int *vcount, *queue, *seen;
+    int v, k, j, u, head, tail;
+    double max;
+
+    (void)worker;
+    c->exact = c->n <= MAX_VARS;
+    c->cnt = xcalloc(c->n + 1, sizeof(*c->cnt));
+    if (!c->exact) {
+        estimate(c, job->byId);
+        return;
+    }
+    c->cell = xcalloc((long)c->n * (c->n + 1), sizeof(*c->cell));
+
+    /* constraints of every field */
+    e.c = c;
+    e.vcStart = xcalloc(c->n + 1, sizeof(int));
+    vcount = xcalloc(c->n + 1, sizeof(int));
+    for (j = 0; j < c->ncons; ++j)
+        for (k = 0; k < c->cons[j]->n; ++k)
+            ++e.vcStart[job->byId[c->cons[j]->var[k]] + 1];
+    for (v = 0; v < c->n; ++v)
+        e.vcStart[v+1] += e.vcStart[v];
+    e.vcList = xmalloc(e.vcStart[c->n] * sizeof(int));
+    for (j = 0; j < c->ncons; ++j) {
+        for (k = 0; k < c->cons[j]->n; ++k) {
+            v = job->byId[c->cons[j]->var[k]];
+            e.vcList[e.vcStart[v] + vcount[v]++] = j;
+        }
+    }
+
+    /* breadth first order keeps constraints closing early */
+    e.order = xmalloc(c->n * sizeof(int));
+    queue = e.order;
+    seen = xcalloc(c->n, sizeof(int));
+    head = tail = 0;
+    queue[tail++] = 0;
+    seen[0] = 1;
+    while (head < tail) {
+        v = queue[head++];
+        for (k = e.vcStart[v]; k < e.vcStart[v+1]; ++k) {
+            j = e.vcList[k];
+            for (u = 0; u < c->cons[j]->n; ++u) {
+                int w = job->byId[c->cons[j]->var[u]];
+                if (!seen[w]) {
+                    seen[w] = 1;
+                    queue[tail++] = w;
+                }
+            }
+        }
+    }
+
+    e.sum = xcalloc(c->ncons, sizeof(int));
+    e.left = xmalloc(c->ncons * sizeof(int));
+    for (j = 0; j < c->ncons; ++j)
+        e.left[j] = c->cons[j]->n;
+    e.val = xcalloc(c->n, 1);
+    e.mines = 0;
+    e.nodes = 0;
+    search(&e, 0);
+
+    if (!c->exact) {
+        estimate(c, job->byId);
+    }
+    else {
+        /* only ratios matter, keep the numbers in range */
+        for (max = 0, k = 0; k <= c->n; ++k)
+            max = c->cnt[k] > max ? c->cnt[k] : max;
+        if (max > 0) {
+            for (k = 0; k <= c->n; ++k)
+                c->cnt[k] /= max;
+            for (k = 0; k < c->n * (c->n + 1); ++k)
+                c->cell[k] /= max;
+        }
+    }
+
+    free(e.vcStart);
+    free(vcount);
+    free(e.vcList);
+    free(e.order);
+    free(seen);
+    free(e.sum);
+    free(e.left);
+    free(e.val);
+}
+
+
+/* r = a * b, normalised to a maximum of 1 */
+static int convolve(const double *a, int na, const double *b, int nb, double *r)
+{
+    int i, j;
+    double max = 0;
+
+    for (i = 0; i < na + nb - 1; ++i)
+        r[i] = 0;
+    for (i = 0; i < na; ++i)
+        for (j = 0; j < nb; ++j)
+            r[i+j] += a[i] * b[j];
+    for (i = 0; i < na + nb - 1; ++i)
+        max = r[i] > max ? r[i] : max;
+    if (max > 0)
+        for (i = 0; i < na + nb - 1; ++i)
+            r[i] /= max;
+    return na + nb - 1;
+}
+
+
+/* add the open number at x, y with the covered fields around it */
+static void addCon(Board *b, int x, int y, Con **cons, long *n, long *size)
+{
+    Con *c;
+    int i;
+    Cell nb;
+
+    if (!cellNb(b, x, y))
+        return;
+    if (*n == *size) {
+        *size = *size ? 2 * *size : 256;
+        *cons = realloc(*cons, *size * sizeof(**cons));
+        if (!*cons)
+            noMem();
+    }
+    c = &(*cons)[*n];
+    c->value = cellNb(b, x, y);
+    c->n = 0;
+    for (i = 0; i < b->topo->n; ++i) {
+        if (!neighbour(b, x, y, i, &nb) || testBit(b, OPEN, nb.x, nb.y))
+            continue;
+        if (testBit(b, FLAG, nb.x, nb.y))
+            --c->value;
+        else
+            c->var[c->n++] = (long)nb.y * b->w + nb.x;
+    }
+    if (c->n)
+        ++*n;
+}
+
+
+/* gather open numbers and the covered fields around them
+ * only the words of allocated tiles holding open fields are looked at */
+static long collect(Prob *p, Con **consOut, long *ncons)
+{
+    Board *b = p->b;
+    Con *cons = NULL;
+    long n = 0, size = 0, t, slot;
+    int x0, y0, y, k;
+    uint64_t bits;
+    Tile *tile;
+
+    for (t = 0; t < b->ntiles; ++t) {
+        slot = b->used[t];
+        tile = b->tiles[slot];
+        x0 = (int)(slot % b->ntx) << b->tshift;
+        y0 = (int)(slot / b->ntx) << b->tshift;
+        for (y = y0; y < y0 + b->th && y < b->h; ++y) {
+            for (k = 0; k < b->rw; ++k) {
+                bits = *tileWord(b, tile, OPEN, x0 + 64 * k, y)
+                    & ~*tileWord(b, tile, MINE, x0 + 64 * k, y);
+                for (; bits; bits &= bits - 1)
+                    addCon(b, x0 + 64 * k + __builtin_ctzll(bits), y, &cons, &n, &size);
+            }
+        }
+    }
+    *consOut = cons;
+    *ncons = n;
+    return n;
+}
+
+
+/* probabilities of the fields of component c, given the weight q[m] of
+ * it holding m bombs and the total weight W */
+static void spread(Prob *p, const Comp *c, const double *q, double W)
+{
+    double num;
+    int v, m;
+
+    for (v = 0; v < c->n; ++v) {
+        if (!c->cell) {
+            p->p[c->vars[v]] = c->dens[v];
+            continue;
+        }
+        for (num = 0, m = 0; m <= c->n; ++m)
+            num += c->cell[(long)v * (c->n + 1) + m] * q[m];
+        p->p[c->vars[v]] = num / W;
+    }
+}
+
+
+/* weight the components by the ways to place the remaining M bombs on
+ * the U fields off the frontier, combining them over the number of bombs
+ * they hold together
+ * returns errorcode, -1 if no placement fits */
+static int combine(Prob *p, Comp *comps, int ncomp, long U, long M)
+{
+    long F = p->nfront, m, s;
+    int j, deg, *len, err = 0;
+    double *lb, lbmax, **pre, **suf, *r, *q, W, E;
+
+    lb = xmalloc((F + 1) * sizeof(*lb));
+    for (lbmax = -INFINITY, s = 0; s <= F; ++s) {
+        m = M - s;
+        lb[s] = (m < 0 || m > U) ? -INFINITY
+            : lchoose(U, m);
+        lbmax = lb[s] > lbmax ? lb[s] : lbmax;
+    }
+    for (s = 0; s <= F; ++s)
+        lb[s] = isinf(lb[s]) ? 0 : exp(lb[s] - lbmax);
+
+    /* products of all components before and after each one */
+    pre = xmalloc((ncomp + 1) * sizeof(*pre));
+    suf = xmalloc((ncomp + 1) * sizeof(*suf));
+    len = xmalloc((2 * ncomp + 2) * sizeof(*len));
+    pre[0] = xmalloc(sizeof(double));
+    pre[0][0] = 1;
+    len[0] = 1;
+    for (j = 0; j < ncomp; ++j) {
+        pre[j+1] = xmalloc((len[j] + comps[j].n) * sizeof(double));
+        len[j+1] = convolve(pre[j], len[j], comps[j].cnt, comps[j].n + 1, pre[j+1]);
+    }
+    suf[ncomp] = xmalloc(sizeof(double));
+    suf[ncomp][0] = 1;
+    len[ncomp + 1 + ncomp] = 1;
+    for (j = ncomp - 1; j >= 0; --j) {
+        suf[j] = xmalloc((len[ncomp + 1 + j + 1] + comps[j].n) * sizeof(double));
+        len[ncomp + 1 + j] = convolve(suf[j+1], len[ncomp + 1 + j + 1],
+                comps[j].cnt, comps[j].n + 1, suf[j]);
+    }
+
+    r = xmalloc((F + 1) * sizeof(*r));
+    q = xmalloc((F + 1) * sizeof(*q));
+    for (j = 0; j < ncomp; ++j) {
+        Comp *c = &comps[j];
+        /* all other components, then weight of c holding m bombs */
+        deg = convolve(pre[j], len[j], suf[j+1], len[ncomp + 1 + j + 1], r);
+        for (W = 0, m = 0; m <= c->n; ++m) {
+            for (q[m] = 0, s = 0; s < deg && s + m <= F; ++s)
+                q[m] += r[s] * lb[s + m];
+            W += c->cnt[m] * q[m];
+        }
+        if (W <= 0) {
+            err = -1;
+            break;
+        }
+        spread(p, c, q, W);
+    }
+
+    /* expected bombs off the frontier */
+    for (W = 0, E = 0, s = 0; s < len[ncomp] && s <= F; ++s) {
+        W += pre[ncomp][s] * lb[s];
+        E += pre[ncomp][s] * lb[s] * (M - s);
+    }
+    if (W <= 0)
+        err = -1;
+    p->rest = (U > 0 && W > 0) ? E / W / U : 0;
+
+    for (j = 0; j <= ncomp; ++j) {
+        free(pre[j]);
+        free(suf[j]);
+    }
+    free(pre);
+    free(suf);
+    free(len);
+    free(r);
+    free(q);
+    free(lb);
+    return err;
+}
+
+
+/* weights q[m] of component c holding m bombs, each bomb by the odds,
+ * relative to the heaviest bomb count to keep them in range
+ * returns the bombs c is expected to hold, W is the total weight */
+static double weigh(const Comp *c, double odds, double *q, double *W)
+{
+    double shift = -INFINITY, E = 0;
+    int m;
+
+    for (m = 0; m <= c->n; ++m)
+        if (c->cnt[m] > 0 && log(c->cnt[m]) + m * odds > shift)
+            shift = log(c->cnt[m]) + m * odds;
+    for (*W = 0, m = 0; m <= c->n; ++m) {
+        q[m] = c->cnt[m] > 0 ? exp(m * odds - shift) : 0;
+        *W += c->cnt[m] * q[m];
+        E += m * c->cnt[m] * q[m];
+    }
+    return *W > 0 ? E / *W : 0;
+}
+
+
+/* weight every component on its own for frontiers too large to combine,
+ * a bomb by the odds of the fields off the frontier. their density is
+ * chosen so that they and the components are expected to hold the M
+ * bombs left
+ * returns errorcode, -1 if a component has no configuration */
+static int approximate(Prob *p, Comp *comps, int ncomp, long U, long M)
+{
+    double *q, odds, lo = -40, hi = 40, E, W;
+    int i, j;
+
+    /* largest component first */
+    q = xmalloc(((ncomp ? comps[0].n : 0) + 1) * sizeof(*q));
+    for (i = 0; i < 40; ++i) {
+        odds = (lo + hi) / 2;
+        for (E = 0, j = 0; j < ncomp; ++j)
+            E += weigh(&comps[j], odds, q, &W);
+        if (E + U / (1 + exp(-odds)) > M)
+            hi = odds;
+        else
+            lo = odds;
+    }
+    odds = (lo + hi) / 2;
+    for (j = 0; j < ncomp; ++j) {
+        weigh(&comps[j], odds, q, &W);
+        if (W <= 0)
+            break;
+        spread(p, &comps[j], q, W);
+    }
+    p->rest = U > 0 ? 1 / (1 + exp(-odds)) : 0;
+    free(q);
+    return j < ncomp ? -1 : 0;
+}
+
+
+static int cmpComp(const void *a, const void *b)
+{
+    return ((const Comp *)b)->n - ((const Comp *)a)->n;
+}
+
+
+/* compute the bomb probability of every covered field
+ * returns errorcode, -1 if no placement of bombs fits the board */
+int probCompute(Prob *p)
+{
+    Board *b = p->b;
+    Con *cons;
+    Comp *comps;
+    Work job;
+    long ncons, nc, i, k, U, M, F, *found, *cand;
+    int *parent, *compOf, ncomp, j;
+    int err = 0;
+
+    probFree(p);
+    p->exact = true;
+    collect(p, &cons, &ncons);
+
+    /* frontier as sorted unique field indices */
+    cand = xmalloc(8 * ncons * sizeof(*cand));
+    for (nc = 0, i = 0; i < ncons; ++i)
+        for (j = 0; j < cons[i].n; ++j)
+            cand[nc++] = cons[i].var[j];
+    qsort(cand, nc, sizeof(*cand), cmpLong);
+    for (F = 0, i = 0; i < nc; ++i)
+        if (!F || cand[i] != cand[F-1])
+            cand[F++] = cand[i];
+    p->front = cand;
+    p->nfront = F;
+    p->p = xcalloc(F, sizeof(*p->p));
+    for (i = 0; i < ncons; ++i) {
+        for (j = 0; j < cons[i].n; ++j) {
+            found = bsearch(&cons[i].var[j], cand, F, sizeof(*cand), cmpLong);
+            cons[i].var[j] = found - cand;
+        }
+    }
+
+    /* split into components sharing constraints */
+    parent = xmalloc(F * sizeof(*parent));
+    for (i = 0; i < F; ++i)
+        parent[i] = i;
+    for (i = 0; i < ncons; ++i)
+        for (j = 1; j < cons[i].n; ++j)
+            parent[findRoot(parent, cons[i].var[j])] = findRoot(parent, cons[i].var[0]);
+    compOf = xmalloc(F * sizeof(*compOf));
+    for (ncomp = 0, i = 0; i < F; ++i)
+        if (findRoot(parent, i) == i)
+            compOf[i] = ncomp++;
+    comps = xcalloc(ncomp, sizeof(*comps));
+    for (i = 0; i < F; ++i)
+        ++comps[compOf[findRoot(parent, i)]].n;
+    for (i = 0; i < ncons; ++i)
+        ++comps[compOf[findRoot(parent, cons[i].var[0])]].ncons;
+    for (j = 0; j < ncomp; ++j) {
+        comps[j].vars = xmalloc(comps[j].n * sizeof(int));
+        comps[j].cons = xmalloc(comps[j].ncons * sizeof(Con *));
+        comps[j].n = comps[j].ncons = 0;
+    }
+    job.byId = xmalloc(F * sizeof(int));
+    for (i = 0; i < F; ++i) {
+        Comp *c = &comps[compOf[findRoot(parent, i)]];
+        job.byId[i] = c->n;
+        c->vars[c->n++] = i;
+    }
+    for (i = 0; i < ncons; ++i) {
+        Comp *c = &comps[compOf[findRoot(parent, cons[i].var[0])]];
+        c->cons[c->ncons++] = &cons[i];
+    }
+
+    /* largest first spreads the work best */
+    qsort(comps, ncomp, sizeof(*comps), cmpComp);
+    job.comps = comps;
+    poolRun(p->pool, enumerate, &job, ncomp);
+
+    /* ways to place the remaining bombs on the other covered fields */
+    U = b->tot - b->opened - b->flags - F;
+    M = b->bombs - b->flags;
+    p->nrest = U;
+    for (j = 0; j < ncomp; ++j)
+        p->exact &= comps[j].exact;
+    if ((double)ncomp * F * F <= PROB_COMBINE) {
+        err = combine(p, comps, ncomp, U, M);
+    }
+    else {
+        p->exact = false;
+        err = approximate(p, comps, ncomp, U, M);
+    }
+
+    /* some field off the frontier to step on */
+    p->restCell = (Cell){-1, -1};
+    for (k = 0, i = 0; U > 0 && i < b->tot; ++i) {
+        while (k < F && cand[k] < i)
+            ++k;
+        if (k < F && cand[k] == i)
+            continue;
+        if (!testBit(b, OPEN, i % b->w, i / b->w) && !testBit(b, FLAG, i % b->w, i / b->w)) {
+            p->restCell = (Cell){i % b->w, i / b->w};
+            break;
+        }
+    }
+
+    for (j = 0; j < ncomp; ++j) {
+        free(comps[j].vars);
+        free(comps[j].cons);
+        free(comps[j].cnt);
+        free(comps[j].cell);
+        free(comps[j].dens);
+    }
+    free(comps);
+    free(compOf);
+    free(parent);
+    free(job.byId);
+    free(cons);
+
+    return err;
+}
+
+
+/* bomb probability of a covered field */
+double probAt(const Prob *p, int x, int y)
+{
+    long i = (long)y * p->b->w + x;
+    long *found = bsearch(&i, p->front, p->nfront, sizeof(*p->front), cmpLong);
+
+    return found ? p->p[found - p->front] : p->rest;
+}
+
+
+/* covered field least likely to hold a bomb
+ * returns false if there is none */
+bool probBest(const Prob *p, Coord *next)
+{
+    double best = 2;
+    long i;
+
+    next->c = 'C';
+    if (p->nrest > 0 && p->restCell.x >= 0) {
+        best = p->rest;
+        next->x = p->restCell.x;
+        next->y = p->restCell.y;
+    }
+    for (i = 0; i < p->nfront; ++i) {
+        if (p->p[i] < best) {
+            best = p->p[i];
+            next->x = p->front[i] % p->b->w;
+            next->y = p->front[i] / p->b->w;
+        }
+    }
+    return best <= 1;
+}
@@ -0,0 +1,451 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "regions.h"
+#include "journal.h"
+#include "stats.h"
+
+/* zero regions
+ *
+ * the board is cut into bands of rows which are labelled in parallel by a
+ * union find over field indices. every band joins each zero field with
+ * the zero neighbours before it in the same band, the root of a set is
+ * always its smallest field. the first row of every band is then joined
+ * with its neighbours in other bands, which closes the seams and, on
+ * wrapping boards, the edges. a last pass numbers the roots in order and
+ * collects the fields of every region with the numbers around it. the
+ * bands keep their zero fields as bit rows, numbers with no zero field in
+ * the 3 x 3 box around them only count towards 3BV and are skipped a word
+ * at a time.
+ *
+ * 3BV, the clicks needed to solve the board, is the number of regions plus
+ * the numbers next to none of them. */
+
+/* fewest rows of a band */
+#define BAND_MIN    64
+
+typedef struct Bands {
+    Regions *r;
+    int rows;           /* per band */
+} Bands;
+
+
+static void noMem(void)
+{
+    fprintf(stderr, "Failed to allocate memory!\n");
+    exit(EXIT_FAILURE);
+}
+
+
+/* attach regions to the board and label them if its bombs are placed
+ * returns errorcode, boards of more than REGIONS_MAX fields and endless
+ * boards are left alone */
+int regionsInit(Regions *r, Board *b, Pool *pool)
+{
+    memset(r, 0, sizeof(*r));
+    if (b->tot > REGIONS_MAX || b->lazy)
+        return -1;
+    r->b = b;
+    r->pool = pool;
+    r->words = (b->w + 63) / 64;
+    r->label = malloc(b->tot * sizeof(*r->label));
+    r->zero = malloc((long)b->h * r->words * sizeof(*r->zero));
+    if (!r->label || !r->zero) {
+        regionsFree(r);
+        return -1;
+    }
+    b->regions = r;
+    if (b->armed)
+        regionsLabel(r);
+    return 0;
+}
+
+
+void regionsFree(Regions *r)
+{
+    if (r->b && r->b->regions == r)
+        r->b->regions = NULL;
+    free(r->label);
+    free(r->zero);
+    free(r->start);
+    free(r->cells);
+    free(r->pairs);
+    r->label = r->start = r->cells = NULL;
+    r->zero = NULL;
+    r->pairs = NULL;
+    r->ready = false;
+}
+
+
+static uint32_t find(uint32_t *p, uint32_t i)
+{
+    while (p[i] != i) {
+        p[i] = p[p[i]];
+        i = p[i];
+    }
+    return i;
+}
+
+
+/* merge the sets of i and j, the smaller root stays */
+static void join(uint32_t *p, uint32_t i, uint32_t j)
+{
+    i = find(p, i);
+    j = find(p, j);
+    if (i < j)
+        p[j] = i;
+    else
+        p[i] = j;
+}
+
+
+/* zero fields among x...x+63 of row y, x a multiple of 64, the tile
+ * must be counted */
+static uint64_t zeroWord(const Board *b, int x, int y)
+{
+    Tile *t = tileAt(b, x, y);
+    const uint8_t *nb = tileNbPlane(b, t) + (long)(y & b->tmask) * b->ns + ((x & b->tmask) >> 1);
+    uint64_t zero = 0;
+    unsigned lo, hi;
+    int i, n = b->w - x < 64 ? b->w - x : 64;
+
+    for (i = 0; i < n; i += 2) {
+        lo = !(nb[i >> 1] & 0xf);
+        hi = !(nb[i >> 1] >> 4);
+        zero |= (uint64_t)(lo | hi << 1) << i;
+    }
+    if (n < 64)
+        zero &= (1ULL << n) - 1;
+    return zero & ~*tileWord(b, t, MINE, x, y);
+}
+
+
+/* count the neighbours of tile i of the board */
+static void countJob(void *arg, long i, int worker)
+{
+    Board *b = arg;
+    long k = b->used[i];
+    Tile *t = b->tiles[k];
+
+    (void)worker;
+    if (!t->nbReady)
+        countTile(b, t, k % b->ntx, k / b->ntx);
+}
+
+
+/* join the zero fields of band k */
+static void bandJob(void *arg, long k, int worker)
+{
+    Bands *bands = arg;
+    Regions *r = bands->r;
+    Board *b = r->b;
+    uint32_t *p = r->label;
+    int y0 = k * bands->rows, y1 = y0 + bands->rows < b->h ? y0 + bands->rows : b->h;
+    uint64_t zero;
+    int x0, x, y, n;
+    long i, j;
+    Cell c;
+
+    (void)worker;
+    for (i = (long)y0 * b->w; i < (long)y1 * b->w; ++i)
+        p[i] = NO_REGION;
+    for (y = y0; y < y1; ++y) {
+        for (x0 = 0; x0 < b->w; x0 += 64) {
+            zero = r->zero[(long)y * r->words + x0 / 64] = zeroWord(b, x0, y);
+            for (; zero; zero &= zero - 1) {
+                x = x0 + __builtin_ctzll(zero);
+                i = (long)y * b->w + x;
+                p[i] = i;
+                for (n = 0; n < b->topo->n; ++n) {
+                    if (!neighbour(b, x, y, n, &c) || c.y < y0)
+                        continue;
+                    j = (long)c.y * b->w + c.x;
+                    if (j < i && p[j] != NO_REGION)
+                        join(p, i, j);
+                }
+            }
+        }
+    }
+}
+
+
+/* zero fields of row y around x...x+63, without wrapping */
+static uint64_t rowNear(const Regions *r, int x, int y)
+{
+    const uint64_t *z = r->zero + (long)y * r->words + x / 64;
+    uint64_t left = x ? z[-1] >> 63 : 0;
+    uint64_t right = x / 64 + 1 < r->words ? z[1] << 63 : 0;
+
+    return *z | *z << 1 | left | *z >> 1 | right;
+}
+
+
+/* fields among x...x+63 of row y with a zero field in the 3 x 3 box
+ * around them, every neighbourhood lies within it. on wrapping boards the
+ * first and last column are always taken */
+static uint64_t nearWord(const Regions *r, int x, int y)
+{
+    const Board *b = r->b;
+    uint64_t near = rowNear(r, x, y);
+
+    if (b->topo->wrap) {
+        near |= rowNear(r, x, (y + b->h - 1) % b->h) | rowNear(r, x, (y + 1) % b->h);
+        if (!x)
+            near |= 1;
+        if (b->w - 1 - x < 64)
+            near |= 1ULL << (b->w - 1 - x);
+        return near;
+    }
+    if (y > 0)
+        near |= rowNear(r, x, y - 1);
+    if (y + 1 < b->h)
+        near |= rowNear(r, x, y + 1);
+    return near;
+}
+
+
+/* label the zero regions of the board and collect their fields */
+void regionsLabel(Regions *r)
+{
+    Board *b = r->b;
+    uint32_t *p = r->label, *cnt, seen[8];
+    uint64_t zero, num, near, todo;
+    Bands bands;
+    long i, j, k, nbands;
+    int x0, x, y, n, ns;
+    Cell c;
+    STAT_CLOCK(start);
+
+    /* every tile counted, so that bands only read the board */
+    if (b->tiled) {
+        for (y = 0; y < b->h; y += b->th)
+            for (x = 0; x < b->w; x += b->tw)
+                tileFor(b, x, y);
+        poolRun(r->pool, countJob, b, b->ntiles);
+    }
+
+    bands.r = r;
+    nbands = poolSize(r->pool);
+    bands.rows = (b->h + nbands - 1) / nbands;
+    if (bands.rows < BAND_MIN)
+        bands.rows = BAND_MIN;
+    nbands = (b->h + bands.rows - 1) / bands.rows;
+    poolRun(r->pool, bandJob, &bands, nbands);
+
+    /* seams between the bands and across wrapping edges */
+    for (k = 0; k < nbands; ++k) {
+        y = k * bands.rows;
+        for (x = 0; x < b->w; ++x) {
+            i = (long)y * b->w + x;
+            if (p[i] == NO_REGION)
+                continue;
+            for (n = 0; n < b->topo->n; ++n) {
+                if (!neighbour(b, x, y, n, &c) || c.y / bands.rows == k)
+                    continue;
+                j = (long)c.y * b->w + c.x;
+                if (p[j] != NO_REGION)
+                    join(p, i, j);
+            }
+        }
+    }
+
+    /* roots come first in their set, number them in order */
+    r->nregions = 0;
+    for (y = 0; y < b->h; ++y) {
+        for (x0 = 0; x0 < b->w; x0 += 64) {
+            zero = r->zero[(long)y * r->words + x0 / 64];
+            for (; zero; zero &= zero - 1) {
+                i = (long)y * b->w + x0 + __builtin_ctzll(zero);
+                p[i] = p[i] == i ? (uint32_t)r->nregions++ : p[p[i]];
+            }
+        }
+    }
+
+    if (r->nregions + 1 > r->startSize) {
+        r->startSize = r->nregions + 1;
+        free(r->start);
+        r->start = malloc(r->startSize * sizeof(*r->start));
+        if (!r->start)
+            noMem();
+    }
+    memset(r->start, 0, (r->nregions + 1) * sizeof(*r->start));
+
+    /* every field with the regions it belongs to, in order, counting the
+     * sizes one further up. a number next to several fields of a region is
+     * taken once, numbers far from any zero field are only counted */
+    cnt = r->start + 1;
+    r->bbbv = r->nregions;
+    r->ncells = 0;
+    for (y = 0; y < b->h; ++y) {
+        for (x0 = 0; x0 < b->w; x0 += 64) {
+            zero = r->zero[(long)y * r->words + x0 / 64];
+            num = ~(zero | *tileWord(b, tileAt(b, x0, y), MINE, x0, y));
+            if (b->w - x0 < 64)
+                num &= (1ULL << (b->w - x0)) - 1;
+            near = nearWord(r, x0, y);
+            r->bbbv += __builtin_popcountll(num & ~near);
+            for (todo = zero | (num & near); todo; todo &= todo - 1) {
+                x = x0 + __builtin_ctzll(todo);
+                i = (long)y * b->w + x;
+                if (p[i] != NO_REGION) {
+                    seen[0] = p[i];
+                    ns = 1;
+                }
+                else {
+                    for (ns = 0, n = 0; n < b->topo->n; ++n) {
+                        if (!neighbour(b, x, y, n, &c))
+                            continue;
+                        j = p[(long)c.y * b->w + c.x];
+                        if (j == NO_REGION)
+                            continue;
+                        for (k = 0; k < ns && seen[k] != j; ++k)
+                            ;
+                        if (k == ns)
+                            seen[ns++] = j;
+                    }
+                    r->bbbv += !ns;
+                }
+                if (r->ncells + ns > r->pairsSize) {
+                    r->pairsSize = r->pairsSize ? 2 * r->pairsSize : 1024;
+                    r->pairs = realloc(r->pairs, r->pairsSize * sizeof(*r->pairs));
+                    if (!r->pairs)
+                        noMem();
+                }
+                for (k = 0; k < ns; ++k) {
+                    ++cnt[seen[k]];
+                    r->pairs[r->ncells++] = (Pair){ seen[k], i };
+                }
+            }
+        }
+    }
+
+    /* sort the fields by region, keeping their order */
+    for (k = 0; k < r->nregions; ++k)
+        r->start[k + 1] += r->start[k];
+    if (r->ncells > r->cellsSize) {
+        r->cellsSize = r->ncells;
+        free(r->cells);
+        r->cells = malloc(r->cellsSize * sizeof(*r->cells));
+        if (!r->cells)
+            noMem();
+    }
+    for (k = 0; k < r->ncells; ++k)
+        r->cells[r->start[r->pairs[k].region]++] = r->pairs[k].cell;
+    /* filling moved start[k] up to the end of region k */
+    memmove(r->start + 1, r->start, r->nregions * sizeof(*r->start));
+    r->start[0] = 0;
+
+    r->ready = true;
+    STAT_ADD(labels, 1);
+    STAT_SINCE(labelNs, start);
+}
+
+
+/* a field of region l is flagged or one of its zero fields is open
+ * already, as left by a fill around a flag removed since. the flood fill
+ * stops at both, so it has to uncover the region */
+static bool blocked(const Regions *r, uint32_t l)
+{
+    const Board *b = r->b;
+    uint32_t k, i;
+    int x, y;
+
+    for (k = r->start[l]; k < r->start[l + 1]; ++k) {
+        i = r->cells[k];
+        x = i % b->w;
+        y = i / b->w;
+        if (testBit(b, FLAG, x, y)
+                || (r->label[i] != NO_REGION && testBit(b, OPEN, x, y)))
+            return true;
+    }
+    return false;
+}
+
+
+/* uncover the fields of region l, or'ing them into the open plane a word
+ * at a time
+ * returns number of uncovered fields */
+static long openRegion(Regions *r, uint32_t l)
+{
+    Board *b = r->b;
+    const uint32_t *c = r->cells + r->start[l], *end = r->cells + r->start[l + 1];
+    uint64_t *word, mask, fresh;
+    long row, stop, opened = 0;
+    int x, y, x0;
+
+    while (c != end) {
+        y = *c / b->w;
+        x = *c % b->w;
+        row = (long)y * b->w;
+        /* fields of the same word */
+        x0 = x & ~63;
+        stop = row + (x0 + 64 < b->w ? x0 + 64 : b->w);
+        for (mask = 0; c != end && *c < stop; ++c)
+            mask |= 1ULL << ((*c - row) & 63);
+
+        word = tileWord(b, tileFor(b, x, y), OPEN, x, y);
+        fresh = mask & ~*word;
+        *word |= mask;
+        journalNote(b, OPEN, x0, y, fresh);
+        opened += __builtin_popcountll(fresh);
+        for (; fresh; fresh &= fresh - 1)
+            markDirty(b, x0 + __builtin_ctzll(fresh), y);
+    }
+    return opened;
+}
+
+
+/* uncover x, y like openFields, whole regions at a time
+ * falls back to the flood fill where a flag or a partly open region is in
+ * the way, so that both uncover the same fields
+ * returns number of uncovered fields */
+long regionsOpen(Regions *r, int x, int y)
+{
+    Board *b = r->b;
+    uint32_t l = r->label[(long)y * b->w + x];
+    long opened;
+    int i;
+    Cell c;
+
+    /* a number opens its neighbours as well, and the regions of those */
+    if (l != NO_REGION && blocked(r, l))
+        return fillFields(b, x, y);
+    for (i = 0; l == NO_REGION && i < b->topo->n; ++i) {
+        if (neighbour(b, x, y, i, &c) && !testBit(b, OPEN, c.x, c.y)
+                && !testBit(b, FLAG, c.x, c.y)
+                && r->label[(long)c.y * b->w + c.x] != NO_REGION
+                && blocked(r, r->label[(long)c.y * b->w + c.x]))
+            return fillFields(b, x, y);
+    }
+
+    if (l != NO_REGION) {
+        opened = openRegion(r, l);
+    }
+    else {
+        opened = !testBit(b, OPEN, x, y);
+        setBit(b, OPEN, x, y);
+        journalNote(b, OPEN, x, y, (uint64_t)opened << (x & 63));
+        markDirty(b, x, y);
+        for (i = 0; i < b->topo->n; ++i) {
+            if (!neighbour(b, x, y, i, &c) || testBit(b, MINE, c.x, c.y)
+                    || testBit(b, OPEN, c.x, c.y) || testBit(b, FLAG, c.x, c.y))
+                continue;
+            l = r->label[(long)c.y * b->w + c.x];
+            if (l != NO_REGION) {
+                opened += openRegion(r, l);
+                continue;
+            }
+            setBit(b, OPEN, c.x, c.y);
+            journalNote(b, OPEN, c.x, c.y, 1ULL << (c.x & 63));
+            markDirty(b, c.x, c.y);
+            ++opened;
+        }
+    }
+
+    b->opened += opened;
+    b->left -= opened;
+    STAT_ADD(fills, 1);
+    STAT_ADD(cellsOpened, opened);
+    STAT_MAX(fillMax, opened);
+    return opened;
+}
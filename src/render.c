@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "render.h"
+#include "stats.h"
+
+#define DEBUG 0
+
+#define BOLD    "\x1b[1m"
+#define RED     "\x1b[1;97;41m"
+#define RESET   "\x1b[0m"
+#define CLEAR   "\x1b[2J\x1b[H"
+#define REVERSE "\x1b[7m"
+static const char *colors[] = {"\x1b[1;32m", "\x1b[1;32m", "\x1b[1;32m",  /* green */
+                               "\x1b[1;93m", "\x1b[1;93m", "\x1b[1;93m",
+                               "\x1b[1;91m", "\x1b[1;91m",
+                               "\x1b[1;31m"};
+
+/* terminal lines kept below the board for the prompt and the input */
+#define PROMPT_ROWS 3
+
+const char AZ[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+
+/* field x, y is inside the window */
+static bool visible(const Render *r, int x, int y)
+{
+    return x >= r->vx && x < r->vx + r->vw && y >= r->vy && y < r->vy + r->vh;
+}
+
+
+/* keep the window inside the board */
+static void clampView(Render *r, const Board *b)
+{
+    if (r->vx > b->w - r->vw)
+        r->vx = b->w - r->vw;
+    if (r->vy > b->h - r->vh)
+        r->vy = b->h - r->vh;
+    if (r->vx < 0)
+        r->vx = 0;
+    if (r->vy < 0)
+        r->vy = 0;
+}
+
+
+/* size the window to the terminal, 80x24 if fd is none
+ * a new size redraws everything */
+static void fitView(Render *r, const Board *b)
+{
+    struct winsize ws;
+    int cols = 80, rows = 24, vw, vh;
+
+    if (!ioctl(r->fd, TIOCGWINSZ, &ws) && ws.ws_col && ws.ws_row) {
+        cols = ws.ws_col;
+        rows = ws.ws_row;
+    }
+    if (cols == r->cols && rows == r->rows)
+        return;
+    r->cols = cols;
+    r->rows = rows;
+
+    /* status line and column labels above, row labels on the left */
+    if (r->large) {
+        vw = cols - r->digits - 1;
+        vh = rows - 2 - PROMPT_ROWS;
+    }
+    else {
+        /* odd rows of hexagonal boards take two more columns */
+        vw = (cols - 4 - (b->topo->shift ? 2 : 0)) / 4;
+        vh = (rows - 3 - PROMPT_ROWS) / 2;
+    }
+    r->vw = vw < 1 ? 1 : vw < b->w ? vw : b->w;
+    r->vh = vh < 1 ? 1 : vh < b->h ? vh : b->h;
+    clampView(r, b);
+    r->drawn = false;
+}
+
+
+void renderInit(Render *r, int fd, const Board *b, bool large)
+{
+    int n;
+
+    r->fd = fd;
+    r->large = large;
+    r->drawn = false;
+    for (r->digits = 1, n = b->h - 1; n >= 10; n /= 10)
+        ++r->digits;
+    r->cols = r->rows = 0;
+    r->vx = r->vy = 0;
+    r->cursor = false;
+    r->cx = r->cy = r->px = r->py = 0;
+    fitView(r, b);
+    r->buf = NULL;
+    r->len = r->cap = 0;
+}
+
+
+/* move the window by dx, dy fields */
+void renderPan(Render *r, const Board *b, int dx, int dy)
+{
+    int vx = r->vx, vy = r->vy;
+
+    r->vx += dx;
+    r->vy += dy;
+    clampView(r, b);
+    if (r->vx != vx || r->vy != vy)
+        r->drawn = false;
+}
+
+
+/* highlight the field at x, y and keep it in view */
+void renderCursor(Render *r, const Board *b, int x, int y)
+{
+    r->cursor = true;
+    r->cx = x;
+    r->cy = y;
+    renderFocus(r, b, x, y);
+}
+
+
+/* centre the window on x, y unless it is visible already */
+void renderFocus(Render *r, const Board *b, int x, int y)
+{
+    if (visible(r, x, y))
+        return;
+    r->vx = x - r->vw / 2;
+    r->vy = y - r->vh / 2;
+    clampView(r, b);
+    r->drawn = false;
+}
+
+
+void renderFree(Render *r)
+{
+    free(r->buf);
+    r->buf = NULL;
+    r->len = r->cap = 0;
+}
+
+
+/* append n bytes to the frame buffer */
+static void put(Render *r, const char *s, size_t n)
+{
+    char *buf;
+    size_t cap;
+
+    if (r->len + n > r->cap) {
+        for (cap = r->cap ? r->cap : 4096; cap < r->len + n; cap *= 2)
+            ;
+        buf = realloc(r->buf, cap);
+        if (!buf) {
+            fprintf(stderr, "Failed to allocate memory!\n");
+            exit(EXIT_FAILURE);
+        }
+        r->buf = buf;
+        r->cap = cap;
+    }
+    memcpy(r->buf + r->len, s, n);
+    r->len += n;
+}
+
+static void putStr(Render *r, const char *s)
+{
+    put(r, s, strlen(s));
+}
+
+static void putf(Render *r, const char *fmt, ...)
+{
+    char tmp[64];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    put(r, tmp, n < (int)sizeof(tmp) ? n : (int)sizeof(tmp) - 1);
+}
+
+
+/* contents of one field, without the separating bar */
+static void putCell(Render *r, Board *b, int x, int y)
+{
+    int n;
+
+    if (r->cursor && x == r->cx && y == r->cy)
+        putStr(r, REVERSE);
+    if (testBit(b, OPEN, x, y) && testBit(b, MINE, x, y)) {
+        putStr(r, r->large ? BOLD "X" RESET : " " BOLD "X" RESET " ");
+    }
+    else if (testBit(b, OPEN, x, y)) {
+        n = cellNb(b, x, y);
+        putStr(r, r->large ? BOLD : " " BOLD);
+        putStr(r, colors[n]);
+        put(r, &"012345678"[n], 1);
+        putStr(r, r->large ? RESET : RESET " ");
+    }
+    else if (testBit(b, FLAG, x, y)) {
+        putStr(r, r->large ? BOLD RED "F" RESET : BOLD RED "<F>" RESET);
+    }
+    else {
+        putStr(r, r->large ? "." : "   ");
+    }
+    if (r->cursor && x == r->cx && y == r->cy)
+        putStr(r, RESET);
+}
+
+
+/* row y is drawn half a field to the right, odd rows of hexagonal boards
+ * on small boards */
+static bool half(const Board *b, int y)
+{
+    return b->topo->shift && (y & 1);
+}
+
+
+/* format the window of the field array, large boards with one character
+ * per field and columns marked every ten fields */
+static void formatField(Render *r, Board *b)
+{
+    int x0 = r->vx, x1 = r->vx + r->vw;
+    int y0 = r->vy, y1 = r->vy + r->vh;
+    int i, j, n;
+    char label[16];
+
+    if (r->large) {
+        putf(r, "%*s", r->digits + 1, "");
+        for (j = x0; j < x1; j += n) {
+            if (j % 10) {
+                putStr(r, " ");
+                n = 1;
+                continue;
+            }
+            n = snprintf(label, sizeof(label), "%d", j);
+            n = n < x1 - j ? n : x1 - j;
+            put(r, label, n);
+        }
+        putStr(r, "\n");
+        for (i = y0; i < y1; ++i) {
+            putf(r, "%*d ", r->digits, i);
+            for (j = x0; j < x1; ++j)
+                putCell(r, b, j, i);
+            putStr(r, "\n");
+        }
+        return;
+    }
+
+    putStr(r, "   ");
+    for (i = x0; i < x1; ++i)
+        putf(r, "  %c %s", i < ALPHA_MAX ? AZ[i] : '?', (i == x1-1) ? "\n" : "");
+    for (i = y0; i < y1; ++i) {
+        putStr(r, half(b, i) ? "     " : "   ");
+        for (j = x0; j < x1; ++j)
+            putStr(r, (j == x1-1) ? "|---|\n" : "|---");
+        putf(r, half(b, i) ? "%2d   " : "%2d ", i);
+        for (j = x0; j < x1; ++j) {
+            putStr(r, "|");
+            putCell(r, b, j, i);
+        }
+        putStr(r, "|\n");
+    }
+    putStr(r, half(b, y1 - 1) ? "     " : "   ");
+    for (j = x0; j < x1; ++j)
+        putStr(r, (j == x1-1) ? "|---|\n" : "|---");
+}
+
+
+/* append the visible part of the board to the frame */
+void printField(Render *r, Board *b)
+{
+    STAT_CLOCK(start);
+    STAT_LOCAL(len, r->len);
+
+    formatField(r, b);
+    STAT_ADD(prints, 1);
+    STAT_ADD(printBytes, (long)r->len - len);
+    STAT_SINCE(printNs, start);
+}
+
+
+/* screen position of a field, the status line is row 1 */
+static void moveToCell(Render *r, const Board *b, int x, int y)
+{
+    int shift = half(b, y) ? 2 : 0;
+
+    x -= r->vx;
+    y -= r->vy;
+    if (r->large)
+        putf(r, "\x1b[%d;%dH", 3 + y, r->digits + 2 + x);
+    else
+        putf(r, "\x1b[%d;%dH", 4 + 2*y, 5 + 4*x + shift);
+}
+
+
+static void flush(Render *r)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < r->len) {
+        n = write(r->fd, r->buf + off, r->len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        off += n;
+    }
+    r->len = 0;
+}
+
+
+/* draw status line, board and prompt
+ * redraws everything for the first frame, after the window moved or if the
+ * board asks for it, else only the visible fields changed since the last
+ * frame and the cursor */
+void renderFrame(Render *r, Board *b, const char *status, const char *prompt)
+{
+    int i, x, y;
+
+    r->len = 0;
+    fitView(r, b);
+    if (!r->drawn || b->redraw || DEBUG) {
+        if (!DEBUG)
+            putStr(r, CLEAR);
+        putStr(r, status);
+        putStr(r, "\n");
+        printField(r, b);
+        r->drawn = true;
+    }
+    else {
+        putStr(r, "\x1b[H\x1b[2K");
+        putStr(r, status);
+        for (i = 0; i < b->ndirty; ++i) {
+            x = b->dirty[i].x;
+            y = b->dirty[i].y;
+            if (!visible(r, x, y))
+                continue;
+            moveToCell(r, b, x, y);
+            putCell(r, b, x, y);
+        }
+        if (r->cursor && (r->px != r->cx || r->py != r->cy)) {
+            if (visible(r, r->px, r->py)) {
+                moveToCell(r, b, r->px, r->py);
+                putCell(r, b, r->px, r->py);
+            }
+            moveToCell(r, b, r->cx, r->cy);
+            putCell(r, b, r->cx, r->cy);
+        }
+        /* prompt and whatever the user typed below the board */
+        putf(r, "\x1b[%d;1H\x1b[J", r->large ? 3 + r->vh : 4 + 2*r->vh);
+    }
+    putStr(r, prompt);
+    r->px = r->cx;
+    r->py = r->cy;
+    b->ndirty = 0;
+    b->redraw = false;
+
+    STAT_ADD(frameBytes, (long)r->len);
+    flush(r);
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+
+/* saved games
+ *
+ * fixed layout in native byte order, every part aligned to SAVE_ALIGN
+ *
+ *   header      SaveHeader, padded to SAVE_ALIGN
+ *   directory   ntiles entries, tile slot and file offset
+ *   tiles       one block of tileBytes per allocated tile, the Tile
+ *               exactly as it is in memory
+ *
+ * loading maps the file privately and points the board's tiles into the
+ * mapping, so nothing is read until a tile is touched and changes never go
+ * back to the file. padding is left as holes, so files are sparse. */
+
+#define SAVE_MAGIC      "MSWEEPER"
+/* raised with every change of the layout: 2 endless boards, 3 topologies */
+#define SAVE_VERSION    3
+#define SAVE_ORDER      0x01020304u
+#define SAVE_ALIGN      4096L
+
+typedef struct SaveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t order;         /* detects files of another byte order */
+    int32_t w, h;
+    uint8_t tiled, armed, lazy, topo;
+    int32_t tshift;
+    int64_t tileBytes;      /* sizeof(Tile), bit and nb planes */
+    int64_t tileStride;     /* tileBytes rounded up to SAVE_ALIGN */
+    int64_t ntiles;
+    uint64_t seed;
+    uint64_t rng[4];
+    int64_t bombs, opened, left, flags;
+    int64_t dirOffset, dataOffset;
+    uint64_t lazyLimit;     /* endless boards */
+    int32_t safeX, safeY;
+} SaveHeader;
+
+typedef struct SaveEntry {
+    int64_t slot;           /* index into the tiles of the board */
+    int64_t offset;
+} SaveEntry;
+
+
+static long align(long n)
+{
+    return (n + SAVE_ALIGN - 1) / SAVE_ALIGN * SAVE_ALIGN;
+}
+
+
+static size_t tileBytes(const Board *b)
+{
+    return sizeof(Tile) + b->twords * sizeof(uint64_t) + (size_t)b->th * b->ns;
+}
+
+
+static int writeAll(int fd, const void *buf, size_t n, off_t off)
+{
+    const char *p = buf;
+    ssize_t k;
+
+    while (n) {
+        k = pwrite(fd, p, n, off);
+        if (k < 0)
+            return -1;
+        p += k;
+        n -= k;
+        off += k;
+    }
+    return 0;
+}
+
+
+/* save the board to path, through a temporary file renamed at the end
+ * returns errorcode */
+int saveFields(const Board *b, const char *path)
+{
+    SaveHeader hd;
+    SaveEntry e;
+    char tmp[4096];
+    long i;
+    int fd;
+
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, SAVE_MAGIC, sizeof(hd.magic));
+    hd.version = SAVE_VERSION;
+    hd.order = SAVE_ORDER;
+    hd.w = b->w;
+    hd.h = b->h;
+    hd.tiled = b->tiled;
+    hd.armed = b->armed;
+    hd.lazy = b->lazy;
+    hd.topo = b->topo - topologies;
+    hd.lazyLimit = b->lazyLimit;
+    hd.safeX = b->safe.x;
+    hd.safeY = b->safe.y;
+    hd.tshift = b->tshift;
+    hd.tileBytes = tileBytes(b);
+    hd.tileStride = align(hd.tileBytes);
+    hd.seed = b->seed;
+    memcpy(hd.rng, b->rng.s, sizeof(hd.rng));
+    hd.bombs = b->bombs;
+    hd.opened = b->opened;
+    hd.left = b->left;
+    hd.flags = b->flags;
+    hd.ntiles = b->ntiles;
+    hd.dirOffset = SAVE_ALIGN;
+    hd.dataOffset = align(hd.dirOffset + hd.ntiles * sizeof(SaveEntry));
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return -1;
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    /* unwritten padding stays a hole */
+    if (ftruncate(fd, hd.dataOffset + hd.ntiles * hd.tileStride)
+            || writeAll(fd, &hd, sizeof(hd), 0))
+        goto fail;
+    for (i = 0; i < b->ntiles; ++i) {
+        e.slot = b->used[i];
+        e.offset = hd.dataOffset + i * hd.tileStride;
+        if (writeAll(fd, &e, sizeof(e), hd.dirOffset + i * sizeof(e))
+                || writeAll(fd, b->tiles[e.slot], hd.tileBytes, e.offset))
+            goto fail;
+    }
+    if (close(fd))
+        goto unlink;
+    if (rename(tmp, path))
+        goto unlink;
+    return 0;
+
+fail:
+    close(fd);
+unlink:
+    unlink(tmp);
+    return -1;
+}
+
+
+/* header of a file of size bytes fits the format and the file, every
+ * part checked so that no sum overflows
+ * returns errorcode, -2 for a saved game of another version */
+static int checkHeader(const SaveHeader *hd, int64_t size)
+{
+    if (memcmp(hd->magic, SAVE_MAGIC, sizeof(hd->magic)) || hd->order != SAVE_ORDER)
+        return -1;
+    /* nothing else of another layout can be read */
+    if (hd->version != SAVE_VERSION)
+        return -2;
+    if (hd->topo >= NTOPOS)
+        return -1;
+    /* sizes as the command line takes them */
+    if (hd->w < 1 || hd->h < 1 || hd->w > (hd->tiled ? LARGE_MAX : DENSE_MAX_W)
+            || hd->h > (hd->tiled ? LARGE_MAX : DENSE_MAX_H))
+        return -1;
+    if (hd->ntiles < 0 || hd->tileBytes <= 0 || hd->tileStride < hd->tileBytes
+            || hd->tileStride > size || hd->tileStride % SAVE_ALIGN)
+        return -1;
+    if (hd->dirOffset < (int64_t)sizeof(*hd) || hd->dirOffset > size
+            || hd->dirOffset % SAVE_ALIGN
+            || hd->ntiles > (size - hd->dirOffset) / (int64_t)sizeof(SaveEntry))
+        return -1;
+    if (hd->dataOffset < hd->dirOffset || hd->dataOffset > size
+            || hd->dataOffset % SAVE_ALIGN
+            || hd->ntiles > (size - hd->dataOffset) / hd->tileStride)
+        return -1;
+    return 0;
+}
+
+
+/* resume a board saved by saveFields, its tiles are mapped from the file
+ * returns errorcode, -2 if it was saved by another version */
+int loadFields(Board *b, const char *path)
+{
+    SaveHeader hd;
+    SaveEntry *dir;
+    struct stat st;
+    char *map;
+    long i;
+    int fd, err = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(hd)) {
+        close(fd);
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    memcpy(&hd, map, sizeof(hd));
+    if ((err = checkHeader(&hd, st.st_size)))
+        goto fail;
+    err = -1;
+    if (initFields(b, hd.w, hd.h, hd.tiled))
+        goto fail;
+    if (hd.tshift != b->tshift || hd.tileBytes != (int64_t)tileBytes(b)
+            || hd.ntiles > (long)b->ntx * b->nty) {
+        freeFields(b);
+        goto fail;
+    }
+
+    /* the tile placed for dense boards is replaced by the saved one */
+    for (i = 0; i < b->ntiles; ++i)
+        b->tiles[b->used[i]] = NULL;
+    b->map = map;
+    b->mapSize = st.st_size;
+    b->ntiles = 0;
+
+    dir = (SaveEntry *)(map + hd.dirOffset);
+    for (i = 0; i < hd.ntiles; ++i) {
+        if (dir[i].slot < 0 || dir[i].slot >= (long)b->ntx * b->nty
+                || b->tiles[dir[i].slot] || dir[i].offset < hd.dataOffset
+                || dir[i].offset > st.st_size - hd.tileBytes
+                || dir[i].offset % SAVE_ALIGN) {
+            freeFields(b);
+            return -1;
+        }
+        b->tiles[dir[i].slot] = (Tile *)(map + dir[i].offset);
+        b->used[b->ntiles++] = dir[i].slot;
+    }
+
+    setTopology(b, hd.topo);
+    b->armed = hd.armed;
+    b->lazy = hd.lazy;
+    b->lazyLimit = hd.lazyLimit;
+    b->safe = (Cell){ hd.safeX, hd.safeY };
+    b->seed = hd.seed;
+    memcpy(b->rng.s, hd.rng, sizeof(hd.rng));
+    b->bombs = hd.bombs;
+    b->opened = hd.opened;
+    b->left = hd.left;
+    b->flags = hd.flags;
+    return 0;
+
+fail:
+    munmap(map, st.st_size);
+    return err;
+}
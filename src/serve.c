@@ -0,0 +1,585 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "modes.h"
+#include "pool.h"
+#include "stats.h"
+
+/* many games over a unix socket
+ *
+ * every connection plays its own game, one request per line, one reply
+ * line per request unless noted
+ *
+ *   new [W H MINES [SEED]]  start a new game, W H MINES default to the
+ *                           command line, MINES -1 places bombs by the
+ *                           probability instead, replies ok W H MINES SEED
+ *                           boards are at most as large as dense ones or
+ *                           the one given on the command line
+ *   C X Y                   uncover X Y
+ *   F X Y                   toggle flag at X Y
+ *   O X Y                   uncover the unflagged neighbours of the number
+ *                           at X Y once as many flags surround it
+ *                           all three reply open|won|lost and the changed
+ *                           fields as X,Y,V with V one of 0-8, F, . or X,
+ *                           or * if too many changed to list
+ *   undo                    take back the last move, even one that lost
+ *   redo                    make the move taken back last again
+ *                           both reply like moves, or err if there is none
+ *   show                    replies board W H, then H lines of W fields
+ *   quit                    close the connection
+ *
+ * errors reply err and a message. requests are not read while a
+ * connection has more than OUT_MAX bytes of replies waiting to be sent.
+ * the connections are spread over event loops, each with its own epoll
+ * instance, optionally pinned to a core.
+ * sessions, including their boards, are kept for the next connection
+ * instead of being freed. */
+
+/* longest request */
+#define REQ_MAX   256
+/* boards larger than this are not sent by show */
+#define SHOW_MAX    (1L << 20)
+/* pending replies which stop reading requests */
+#define OUT_MAX     (1L << 20)
+/* sessions allocated at once */
+#define SLAB        64
+#define EVENTS      64
+
+typedef struct Session {
+    int fd;
+    Board board;
+    Journal journal;
+    bool ready;         /* board is initialised */
+    bool playing;       /* a game was started by this connection */
+    bool first;         /* bombs not yet placed */
+    bool over;
+    bool held;          /* requests wait until the replies are sent */
+    Cell hit;           /* bomb uncovered by the last lost move */
+    Spec spec;
+    int maxW, maxH;     /* largest board of a new game */
+    char in[REQ_MAX];
+    size_t inLen;
+    char *out;
+    size_t outLen, outOff, outCap;
+    struct Session *nextFree;
+} Session;
+
+/* one event loop and the sessions it owns */
+typedef struct Loop {
+    pthread_t thread;
+    int id;
+    int ep;
+    int listener;
+    bool pin;
+    const Spec *spec;
+    Session *free;
+    Session **slabs;
+    long nslabs;
+} Loop;
+
+static volatile sig_atomic_t stop;
+/* games started without a seed, each gets the next one */
+static long served;
+
+
+static void onStop(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+
+static Session *sessionGet(Loop *l)
+{
+    Session *s, **slabs;
+    long i;
+
+    if (!l->free) {
+        slabs = realloc(l->slabs, (l->nslabs + 1) * sizeof(*slabs));
+        s = calloc(SLAB, sizeof(*s));
+        if (!slabs || !s) {
+            free(s);
+            if (slabs)
+                l->slabs = slabs;
+            return NULL;
+        }
+        l->slabs = slabs;
+        l->slabs[l->nslabs++] = s;
+        for (i = 0; i < SLAB; ++i) {
+            s[i].nextFree = l->free;
+            l->free = &s[i];
+        }
+    }
+    s = l->free;
+    l->free = s->nextFree;
+    s->inLen = s->outLen = s->outOff = 0;
+    s->in[0] = '\0';
+    s->playing = false;
+    s->over = true;
+    s->held = false;
+    s->spec = *l->spec;
+    s->spec.pool = NULL;
+    /* as large as dense boards or the board of the command line */
+    s->maxW = l->spec->w > DENSE_MAX_W ? l->spec->w : DENSE_MAX_W;
+    s->maxH = l->spec->h > DENSE_MAX_H ? l->spec->h : DENSE_MAX_H;
+    return s;
+}
+
+
+/* keep the board, a new connection playing the same size reuses it
+ * the game and its moves are wiped, nothing of it is left to the next one */
+static void sessionPut(Loop *l, Session *s)
+{
+    close(s->fd);
+    if (s->ready)
+        clearFields(&s->board);
+    s->nextFree = l->free;
+    l->free = s;
+}
+
+
+static bool outf(Session *s, const char *fmt, ...)
+{
+    va_list ap;
+    size_t cap;
+    char *buf;
+    int n;
+
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(s->out + s->outLen, s->outCap - s->outLen, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return false;
+        if (s->outLen + n < s->outCap) {
+            s->outLen += n;
+            return true;
+        }
+        for (cap = s->outCap ? s->outCap : 4096; cap <= s->outLen + n; cap *= 2)
+            ;
+        buf = realloc(s->out, cap);
+        if (!buf)
+            return false;
+        s->out = buf;
+        s->outCap = cap;
+    }
+}
+
+
+static char fieldChar(Board *b, int x, int y)
+{
+    if (testBit(b, OPEN, x, y))
+        return testBit(b, MINE, x, y) ? 'X' : "012345678"[cellNb(b, x, y)];
+    return testBit(b, FLAG, x, y) ? 'F' : '.';
+}
+
+
+/* start a game of given size, reusing the board if it fits */
+static int newGame(Session *s, int w, int h, long mines, uint64_t seed)
+{
+    bool tiled = w > DENSE_MAX_W || h > DENSE_MAX_H;
+
+    if (s->ready && s->board.w == w && s->board.h == h && s->board.tiled == tiled) {
+        clearFields(&s->board);
+    }
+    else {
+        if (s->ready) {
+            journalFree(&s->journal);
+            freeFields(&s->board);
+        }
+        s->ready = s->playing = false;
+        if (initFields(&s->board, w, h, tiled))
+            return -1;
+        setTopology(&s->board, s->spec.topo);
+        journalInit(&s->journal, &s->board);
+        s->ready = true;
+    }
+    s->spec.w = w;
+    s->spec.h = h;
+    s->spec.tiled = tiled;
+    s->spec.mines = mines;
+    s->spec.seed = seed;
+    seedFields(&s->board, seed);
+    s->playing = true;
+    s->first = true;
+    s->over = false;
+    s->hit = (Cell){ 0, 0 };
+    return 0;
+}
+
+
+/* the bomb of a lost move is uncovered until the move is taken back */
+static bool lost(Session *s)
+{
+    return testBit(&s->board, MINE, s->hit.x, s->hit.y)
+        && testBit(&s->board, OPEN, s->hit.x, s->hit.y);
+}
+
+
+/* reply the state of the game and the fields changed since the last
+ * reply
+ * returns false on error */
+static bool changes(Session *s)
+{
+    Board *b = &s->board;
+    int i, x, y;
+
+    if (!s->over)
+        outf(s, "open");
+    else if (lost(s))
+        outf(s, "lost");
+    else
+        outf(s, "won");
+    if (b->redraw) {
+        outf(s, " *");
+    }
+    else {
+        for (i = 0; i < b->ndirty; ++i) {
+            x = b->dirty[i].x;
+            y = b->dirty[i].y;
+            outf(s, " %d,%d,%c", x, y, fieldChar(b, x, y));
+        }
+    }
+    b->ndirty = 0;
+    b->redraw = false;
+    return outf(s, "\n");
+}
+
+
+/* answer one request
+ * returns false if the connection is to be closed */
+static bool request(Session *s, char *line)
+{
+    Board *b = &s->board;
+    Coord next;
+    char cmd, row[256];
+    int w, h, n, i, x, y;
+    long mines;
+    unsigned long long seed;
+
+    line += strspn(line, " \t");
+    if (!strncmp(line, "new", 3)) {
+        n = sscanf(line + 3, "%d %d %ld %llu", &w, &h, &mines, &seed);
+        if (n < 3) {
+            w = s->spec.w;
+            h = s->spec.h;
+            mines = s->spec.mines;
+        }
+        if (n < 4)
+            seed = s->spec.seed + __atomic_fetch_add(&served, 1, __ATOMIC_RELAXED);
+        if (w < 1 || h < 1 || w > s->maxW || h > s->maxH
+                || mines < -1 || mines >= (long)w * h)
+            return outf(s, "err invalid board\n");
+        if (newGame(s, w, h, mines, seed))
+            return outf(s, "err out of memory\n");
+        return outf(s, "ok %d %d %ld %llu\n", w, h, mines, seed);
+    }
+
+    if (sscanf(line, " %c %d %d", &cmd, &next.x, &next.y) == 3
+            && (toupper(cmd) == 'C' || toupper(cmd) == 'F'
+                || toupper(cmd) == 'O')) {
+        if (!s->playing || s->over)
+            return outf(s, "err no game\n");
+        if (!inBoard(b, next.x, next.y))
+            return outf(s, "err invalid coordinate\n");
+        next.c = toupper(cmd);
+        if (s->first) {
+            placeBombs(b, &s->spec, &next);
+            s->first = false;
+        }
+        b->ndirty = 0;
+        b->redraw = false;
+        if (step(b, &next)) {
+            /* part of the move, taking it back covers the bomb again */
+            showBomb(b, next.x, next.y);
+            s->hit = (Cell){ next.x, next.y };
+        }
+        s->over = allOpen(b) || lost(s);
+        return changes(s);
+    }
+
+    if (!strncmp(line, "undo", 4) || !strncmp(line, "redo", 4)) {
+        if (!s->playing || s->first)
+            return outf(s, "err no game\n");
+        b->ndirty = 0;
+        b->redraw = false;
+        if (!(line[0] == 'u' ? journalUndo(&s->journal) : journalRedo(&s->journal)))
+            return outf(s, "err nothing to %.4s\n", line);
+        s->over = allOpen(b) || lost(s);
+        return changes(s);
+    }
+
+    if (sscanf(line, " %c", &cmd) != 1)
+        return true;
+    if (!strncmp(line, "show", 4)) {
+        if (!s->playing)
+            return outf(s, "err no game\n");
+        if (b->tot > SHOW_MAX)
+            return outf(s, "err board too large\n");
+        outf(s, "board %d %d\n", b->w, b->h);
+        for (y = 0; y < b->h; ++y) {
+            /* rows are written in pieces of row */
+            for (x = 0; x < b->w; x += sizeof(row)) {
+                n = b->w - x < (int)sizeof(row) ? b->w - x : (int)sizeof(row);
+                for (i = 0; i < n; ++i)
+                    row[i] = fieldChar(b, x + i, y);
+                if (!outf(s, "%.*s", n, row))
+                    return false;
+            }
+            outf(s, "\n");
+        }
+        return true;
+    }
+    if (!strncmp(line, "quit", 4))
+        return false;
+    return outf(s, "err invalid command\n");
+}
+
+
+/* write pending output, wait for the socket if it is full
+ * returns false on error */
+static bool flushOut(Loop *l, Session *s)
+{
+    struct epoll_event ev;
+    ssize_t n;
+
+    while (s->outOff < s->outLen) {
+        n = send(s->fd, s->out + s->outOff, s->outLen - s->outOff, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                return false;
+            /* keep only what is pending, once most of it is sent */
+            if (s->outOff > s->outLen - s->outOff) {
+                memmove(s->out, s->out + s->outOff, s->outLen - s->outOff);
+                s->outLen -= s->outOff;
+                s->outOff = 0;
+            }
+            ev.events = s->held ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+            ev.data.ptr = s;
+            return !epoll_ctl(l->ep, EPOLL_CTL_MOD, s->fd, &ev);
+        }
+        s->outOff += n;
+    }
+    if (s->outLen) {
+        s->outLen = s->outOff = 0;
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        epoll_ctl(l->ep, EPOLL_CTL_MOD, s->fd, &ev);
+    }
+    return true;
+}
+
+
+/* read requests and answer them
+ * returns false if the connection is done */
+static bool readIn(Session *s)
+{
+    char *nl;
+    ssize_t n;
+    size_t len;
+
+    for (;;) {
+        while (!(s->held = s->outLen - s->outOff > OUT_MAX)
+                && (nl = strchr(s->in, '\n'))) {
+            *nl = '\0';
+            if (!request(s, s->in))
+                return false;
+            len = s->in + s->inLen - (nl + 1);
+            memmove(s->in, nl + 1, len + 1);
+            s->inLen = len;
+        }
+        /* the rest is read once the replies are sent */
+        if (s->held)
+            return true;
+        if (s->inLen == sizeof(s->in) - 1) {
+            s->inLen = 0;
+            s->in[0] = '\0';
+            if (!outf(s, "err line too long\n"))
+                return false;
+        }
+
+        n = recv(s->fd, s->in + s->inLen, sizeof(s->in) - 1 - s->inLen, 0);
+        if (n == 0)
+            return false;
+        if (n < 0)
+            return errno == EAGAIN || errno == EINTR;
+        s->inLen += n;
+        s->in[s->inLen] = '\0';
+    }
+}
+
+
+static void acceptAll(Loop *l)
+{
+    struct epoll_event ev;
+    Session *s;
+    int fd;
+
+    while ((fd = accept4(l->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        s = sessionGet(l);
+        if (!s) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(l->ep, EPOLL_CTL_ADD, fd, &ev))
+            sessionPut(l, s);
+    }
+}
+
+
+static void *loopRun(void *arg)
+{
+    Loop *l = arg;
+    struct epoll_event ev[EVENTS];
+    Session *s;
+    cpu_set_t cpus;
+    int i, n;
+
+    if (l->pin) {
+        CPU_ZERO(&cpus);
+        CPU_SET(l->id % cpuCount(), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    while (!stop) {
+        /* wake up now and then to notice a stop request in every loop */
+        n = epoll_wait(l->ep, ev, EVENTS, 500);
+        STATS_POLL();
+        for (i = 0; i < n; ++i) {
+            if (!ev[i].data.ptr) {
+                acceptAll(l);
+                continue;
+            }
+            s = ev[i].data.ptr;
+            /* held requests are answered once the replies are sent */
+            if (s->held && !flushOut(l, s)) {
+                sessionPut(l, s);
+                continue;
+            }
+            if ((ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) || s->held)
+                    && !readIn(s)) {
+                flushOut(l, s);
+                sessionPut(l, s);
+                continue;
+            }
+            if (!flushOut(l, s))
+                sessionPut(l, s);
+        }
+    }
+    return NULL;
+}
+
+
+static void loopFree(Loop *l)
+{
+    Session *s;
+    long i, k;
+
+    for (i = 0; i < l->nslabs; ++i) {
+        for (k = 0; k < SLAB; ++k) {
+            s = &l->slabs[i][k];
+            if (s->ready) {
+                journalFree(&s->journal);
+                freeFields(&s->board);
+            }
+            free(s->out);
+        }
+        free(l->slabs[i]);
+    }
+    free(l->slabs);
+    close(l->ep);
+}
+
+
+/* serve games on the unix socket at path with given number of event loops,
+ * pinned to cores if loops > 1 */
+int runServe(const char *path, int loops, const Spec *spec)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct epoll_event ev;
+    struct stat st;
+    Loop *l;
+    int fd, i, started;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+    /* a socket left behind by an earlier server */
+    if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return EXIT_FAILURE;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onStop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    l = calloc(loops, sizeof(*l));
+    if (!l) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        close(fd);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+    for (started = 0; started < loops; ++started) {
+        l[started].id = started;
+        l[started].listener = fd;
+        l[started].pin = loops > 1;
+        l[started].spec = spec;
+        l[started].ep = epoll_create1(EPOLL_CLOEXEC);
+        /* every loop waits for connections, only one is woken per client */
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = NULL;
+        if (l[started].ep < 0 || epoll_ctl(l[started].ep, EPOLL_CTL_ADD, fd, &ev)) {
+            perror("epoll");
+            if (l[started].ep >= 0)
+                close(l[started].ep);
+            break;
+        }
+        if (started && pthread_create(&l[started].thread, NULL, loopRun, &l[started])) {
+            close(l[started].ep);
+            break;
+        }
+    }
+    if (started)
+        loopRun(&l[0]);
+    for (i = 1; i < started; ++i)
+        pthread_join(l[i].thread, NULL);
+    for (i = 0; i < started; ++i)
+        loopFree(&l[i]);
+
+    free(l);
+    close(fd);
+    unlink(path);
+    return started ? EXIT_SUCCESS : EXIT_FAILURE;
+}
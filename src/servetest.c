@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "modes.h"
+
+/* requests played against a server running in a thread of this process
+ *
+ * every check sends one request and compares the start of the reply. a
+ * connection must never see the game of the one served before it, the
+ * session and board it is given are recycled.
+ *
+ *   servetest.out    prints every failed check, fails if there is one */
+
+#define PATH_LEN    64
+
+static char path[PATH_LEN];
+static Spec spec = { .w = 8, .h = 8, .prob = 0.16, .mines = -1, .seed = 1 };
+static int failed;
+
+
+static void *serve(void *arg)
+{
+    (void)arg;
+    runServe(path, 1, &spec);
+    return NULL;
+}
+
+
+/* connect to the server, waiting for it to listen */
+static int connectTo(void)
+{
+    struct sockaddr_un addr;
+    int fd, i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    for (i = 0; i < 100; ++i) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+            return fd;
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+
+/* send req and check that the reply line starts with want */
+static void expect(int fd, const char *req, const char *want)
+{
+    char line[256];
+    size_t n = 0;
+
+    if (write(fd, req, strlen(req)) != (ssize_t)strlen(req)
+            || write(fd, "\n", 1) != 1) {
+        printf("FAIL %s: not sent\n", req);
+        ++failed;
+        return;
+    }
+    while (n < sizeof(line) - 1 && read(fd, &line[n], 1) == 1 && line[n] != '\n')
+        ++n;
+    line[n] = '\0';
+    if (strncmp(line, want, strlen(want))) {
+        printf("FAIL %s: got \"%s\", want \"%s\"\n", req, line, want);
+        ++failed;
+    }
+}
+
+
+int main(void)
+{
+    pthread_t thread;
+    int fd;
+
+    snprintf(path, sizeof(path), "/tmp/servetest.%d.sock", (int)getpid());
+    if (pthread_create(&thread, NULL, serve, NULL)) {
+        fprintf(stderr, "cannot start the server\n");
+        return EXIT_FAILURE;
+    }
+
+    /* a game played and left unfinished */
+    if ((fd = connectTo()) < 0)
+        goto noserver;
+    expect(fd, "show", "err no game");
+    expect(fd, "undo", "err no game");
+    expect(fd, "new 8 8 10 7", "ok 8 8 10 7");
+    expect(fd, "F 7 7", "open 7,7,F");
+    expect(fd, "C 0 0", "");
+    expect(fd, "undo", "open");
+    close(fd);
+
+    /* the next connection gets the same session, but not the game */
+    if ((fd = connectTo()) < 0)
+        goto noserver;
+    expect(fd, "show", "err no game");
+    expect(fd, "undo", "err no game");
+    expect(fd, "redo", "err no game");
+    expect(fd, "C 1 1", "err no game");
+    expect(fd, "F 1 1", "err no game");
+    expect(fd, "new 8 8 10 7", "ok 8 8 10 7");
+    expect(fd, "undo", "err no game");
+    expect(fd, "redo", "err no game");
+    expect(fd, "F 7 7", "open 7,7,F");
+    expect(fd, "undo", "open 7,7,.");
+    expect(fd, "redo", "open 7,7,F");
+    expect(fd, "redo", "err nothing to redo");
+    close(fd);
+
+    kill(getpid(), SIGTERM);
+    pthread_join(thread, NULL);
+    printf("%s\n", failed ? "serve tests failed" : "serve tests passed");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+
+noserver:
+    fprintf(stderr, "%s: cannot connect\n", path);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "modes.h"
+#include "stats.h"
+#include "pool.h"
+
+/* many games played by the solver on all cores
+ *
+ * game i is seeded with seed + i, so every game can be looked at again
+ * with --autoplay. every worker plays on its own board, solver and tally,
+ * which are only summed up once all games are done. */
+
+typedef struct Tally {
+    long games, won, lost, badFlags;
+    long moves, guesses;
+    long opens;         /* uncover moves */
+    long cells;         /* fields opened by them */
+    long bbbv;
+} Tally;
+
+/* state of one worker, kept on separate cache lines */
+typedef struct Player {
+    Board board;
+    Solver solver;
+    Prob prob;
+    Regions regions;
+    bool ready;
+    Tally t;
+} __attribute__((aligned(64))) Player;
+
+typedef struct Sim {
+    const Spec *spec;
+    Player *players;
+    bool failed;
+} Sim;
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void playOne(void *arg, long i, int worker)
+{
+    Sim *sim = arg;
+    Player *pl = &sim->players[worker];
+    Board *b = &pl->board;
+    Spec spec = *sim->spec;
+    Outcome o;
+
+    /* games are already spread over the workers */
+    spec.pool = NULL;
+    if (!pl->ready) {
+        if (initFields(b, spec.w, spec.h, spec.tiled) || solverInit(&pl->solver, b)) {
+            sim->failed = true;
+            return;
+        }
+        probInit(&pl->prob, b, NULL);
+        /* labelled if asked for, too large boards are flooded */
+        if (spec.regions)
+            regionsInit(&pl->regions, b, NULL);
+        pl->ready = true;
+    }
+
+    spec.seed += i;
+    resetFields(b, spec.seed);
+    solverReset(&pl->solver);
+    autoplay(&pl->solver, &pl->prob, &spec, &o);
+
+    ++pl->t.games;
+    pl->t.won += o.won;
+    pl->t.lost += o.lost;
+    pl->t.badFlags += o.badFlag;
+    pl->t.moves += o.moves;
+    pl->t.guesses += o.guesses;
+    /* the solver never removes flags */
+    pl->t.opens += o.moves - b->flags;
+    pl->t.cells += b->opened;
+    pl->t.bbbv += o.bbbv;
+}
+
+
+int runSimulate(long games, const Spec *spec)
+{
+    Pool *pool = poolCreate(0);
+    Sim sim = { spec, NULL, false };
+    Tally t;
+    int i, n = poolSize(pool);
+    double start;
+
+    sim.players = aligned_alloc(64, n * sizeof(*sim.players));
+    if (!pool || !sim.players) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        poolDestroy(pool);
+        free(sim.players);
+        return EXIT_FAILURE;
+    }
+    memset(sim.players, 0, n * sizeof(*sim.players));
+
+    start = now();
+    poolRun(pool, playOne, &sim, games);
+    start = now() - start;
+
+    memset(&t, 0, sizeof(t));
+    for (i = 0; i < n; ++i) {
+        Player *pl = &sim.players[i];
+        t.games += pl->t.games;
+        t.won += pl->t.won;
+        t.lost += pl->t.lost;
+        t.badFlags += pl->t.badFlags;
+        t.moves += pl->t.moves;
+        t.guesses += pl->t.guesses;
+        t.opens += pl->t.opens;
+        t.cells += pl->t.cells;
+        t.bbbv += pl->t.bbbv;
+        if (pl->ready) {
+            regionsFree(&pl->regions);
+            probFree(&pl->prob);
+            solverFree(&pl->solver);
+            freeFields(&pl->board);
+        }
+    }
+    poolDestroy(pool);
+    free(sim.players);
+
+    if (sim.failed) {
+        fprintf(stderr, "Failed to allocate memory!\n");
+        return EXIT_FAILURE;
+    }
+    printf("games=%ld won=%ld lost=%ld badflags=%ld winrate=%.4f "
+            "moves/game=%.2f guesses/game=%.3f cells/open=%.2f ",
+            t.games, t.won, t.lost, t.badFlags,
+            t.games ? (double)t.won / t.games : 0.,
+            t.games ? (double)t.moves / t.games : 0.,
+            t.games ? (double)t.guesses / t.games : 0.,
+            t.opens ? (double)t.cells / t.opens : 0.);
+    /* only counted on labelled boards */
+    if (spec->regions)
+        printf("3bv/game=%.2f ", t.games ? (double)t.bbbv / t.games : 0.);
+    printf("threads=%d sec=%.3f games/s=%.0f\n",
+            n, start, start > 0 ? t.games / start : 0.);
+    STATS_DUMP();
+    return EXIT_SUCCESS;
+}
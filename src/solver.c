@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "solver.h"
+#include "stats.h"
+
+/* fields around a number are collected in a 7x7 window centred on the
+ * number being examined, so that the fields of numbers up to two steps
+ * away fit into the same 64 bit mask. the window only fits boards of the
+ * square topology */
+#define WIN     7
+#define WBIT(dx, dy)    (1ULL << (((dy) + 3) * WIN + (dx) + 3))
+
+
+int solverInit(Solver *s, Board *b)
+{
+    s->b = b;
+    s->head = s->tail = 0;
+    s->workSize = 256;
+    s->nmoves = 0;
+    s->movesSize = 64;
+    s->work = malloc(s->workSize * sizeof(*s->work));
+    s->moves = malloc(s->movesSize * sizeof(*s->moves));
+    s->queued = calloc((b->tot + 63) / 64, sizeof(*s->queued));
+    if (!s->work || !s->moves || !s->queued) {
+        solverFree(s);
+        return -1;
+    }
+    /* examine everything that is already open */
+    b->redraw = true;
+    return 0;
+}
+
+
+/* forget everything about the previous game, the board must have the same
+ * size as before */
+void solverReset(Solver *s)
+{
+    Board *b = s->b;
+
+    s->head = s->tail = 0;
+    s->nmoves = 0;
+    memset(s->queued, 0, (b->tot + 63) / 64 * sizeof(*s->queued));
+    b->redraw = true;
+}
+
+
+void solverFree(Solver *s)
+{
+    free(s->work);
+    free(s->moves);
+    free(s->queued);
+    s->work = NULL;
+    s->moves = NULL;
+    s->queued = NULL;
+}
+
+
+static void noMem(void)
+{
+    fprintf(stderr, "Failed to allocate memory!\n");
+    exit(EXIT_FAILURE);
+}
+
+
+static void *grow(void *p, long *size, size_t elem)
+{
+    void *q = realloc(p, *size * 2 * elem);
+    if (!q)
+        noMem();
+    *size *= 2;
+    return q;
+}
+
+
+/* put an open number on the worklist */
+static void enqueue(Solver *s, int x, int y)
+{
+    Board *b = s->b;
+    long i = (long)y * b->w + x, n, k;
+    Cell *work;
+
+    if (s->queued[i >> 6] >> (i & 63) & 1)
+        return;
+    if (!testBit(b, OPEN, x, y) || testBit(b, MINE, x, y) || cellNb(b, x, y) == 0)
+        return;
+
+    if (s->tail - s->head == s->workSize) {
+        /* unroll the ring into a buffer of twice the size */
+        n = s->workSize;
+        work = malloc(2 * n * sizeof(*work));
+        if (!work)
+            noMem();
+        for (k = 0; k < n; ++k)
+            work[k] = s->work[(s->head + k) % n];
+        free(s->work);
+        s->work = work;
+        s->workSize = 2 * n;
+        s->head = 0;
+        s->tail = n;
+    }
+    s->work[s->tail++ % s->workSize] = (Cell){x, y};
+    s->queued[i >> 6] |= 1ULL << (i & 63);
+}
+
+
+/* queue the numbers around a changed field */
+static void enqueueAround(Solver *s, int x, int y)
+{
+    int dx, dy;
+
+    for (dy = -1; dy <= 1; ++dy)
+        for (dx = -1; dx <= 1; ++dx)
+            if (inBoard(s->b, x + dx, y + dy))
+                enqueue(s, x + dx, y + dy);
+}
+
+
+/* pick up the fields changed since the last call from the board's dirty
+ * list, an overflown list makes the solver look at every open number
+ * consumes the dirty list */
+void solverNote(Solver *s)
+{
+    Board *b = s->b;
+    int i, x, y;
+
+    if (b->redraw) {
+        for (y = 0; y < b->h; ++y) {
+            for (x = 0; x < b->w; ++x) {
+                if (!tileAt(b, x, y))
+                    x |= b->tmask;      /* skip rest of the tile row */
+                else
+                    enqueue(s, x, y);
+            }
+        }
+    }
+    else {
+        for (i = 0; i < b->ndirty; ++i)
+            enqueueAround(s, b->dirty[i].x, b->dirty[i].y);
+    }
+    b->ndirty = 0;
+    b->redraw = false;
+}
+
+
+/* covered, unflagged fields around x, y as mask in the window centred on
+ * ax, ay, returns the number of bombs still missing among them */
+static int unknowns(Board *b, int x, int y, int ax, int ay, uint64_t *mask)
+{
+    int i, n = cellNb(b, x, y);
+    Cell c;
+
+    *mask = 0;
+    for (i = 0; i < b->topo->n; ++i) {
+        if (!neighbour(b, x, y, i, &c) || testBit(b, OPEN, c.x, c.y))
+            continue;
+        if (testBit(b, FLAG, c.x, c.y))
+            --n;
+        else
+            *mask |= WBIT(c.x - ax, c.y - ay);
+    }
+    return n;
+}
+
+
+static void addMoves(Solver *s, int ax, int ay, uint64_t mask, char c)
+{
+    int bit;
+
+    while (mask) {
+        bit = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        if (s->nmoves == s->movesSize)
+            s->moves = grow(s->moves, &s->movesSize, sizeof(*s->moves));
+        s->moves[s->nmoves++] = (Coord){ax + bit % WIN - 3, ay + bit / WIN - 3, c};
+    }
+}
+
+
+/* apply the single field and the subset rule to the number at ax, ay */
+static void examine(Solver *s, int ax, int ay)
+{
+    Board *b = s->b;
+    uint64_t ua, ub, d;
+    int ra, rb, dx, dy, bx, by;
+
+    ra = unknowns(b, ax, ay, ax, ay, &ua);
+    if (!ua)
+        return;
+    if (ra == 0) {
+        addMoves(s, ax, ay, ua, 'C');
+        return;
+    }
+    if (ra == __builtin_popcountll(ua)) {
+        addMoves(s, ax, ay, ua, 'F');
+        return;
+    }
+
+    /* pairs with numbers sharing covered fields */
+    for (dy = -2; dy <= 2; ++dy) {
+        for (dx = -2; dx <= 2; ++dx) {
+            bx = ax + dx;
+            by = ay + dy;
+            if ((!dx && !dy) || !inBoard(b, bx, by) || !testBit(b, OPEN, bx, by)
+                    || testBit(b, MINE, bx, by) || cellNb(b, bx, by) == 0)
+                continue;
+            rb = unknowns(b, bx, by, ax, ay, &ub);
+            if (!(ua & ub))
+                continue;
+            /* the fields only b sees hold rb - ra bombs, if a within b */
+            if (!(ua & ~ub) && ub != ua) {
+                d = ub & ~ua;
+                if (rb - ra == 0)
+                    addMoves(s, ax, ay, d, 'C');
+                else if (rb - ra == __builtin_popcountll(d))
+                    addMoves(s, ax, ay, d, 'F');
+            }
+            else if (!(ub & ~ua) && ub != ua) {
+                d = ua & ~ub;
+                if (ra - rb == 0)
+                    addMoves(s, ax, ay, d, 'C');
+                else if (ra - rb == __builtin_popcountll(d))
+                    addMoves(s, ax, ay, d, 'F');
+            }
+            if (s->nmoves)
+                return;
+        }
+    }
+}
+
+
+/* find the next certain move
+ * returns false if no safe deduction remains */
+bool solverNext(Solver *s, Coord *next)
+{
+    Board *b = s->b;
+    Cell c;
+    long i;
+
+    for (;;) {
+        while (s->nmoves) {
+            *next = s->moves[--s->nmoves];
+            /* moves found earlier may have been made meanwhile */
+            if (!testBit(b, OPEN, next->x, next->y) && !testBit(b, FLAG, next->x, next->y))
+                return true;
+        }
+        if (s->head == s->tail)
+            return false;
+        c = s->work[s->head++ % s->workSize];
+        i = (long)c.y * b->w + c.x;
+        s->queued[i >> 6] &= ~(1ULL << (i & 63));
+        examine(s, c.x, c.y);
+    }
+}
+
+
+/* make certain moves until none is left or the game is won
+ * returns number of moves, -1 if a move hit a bomb because of a wrong flag */
+long solve(Solver *s)
+{
+    Coord next;
+    long moves = 0;
+
+    solverNote(s);
+    while (!allOpen(s->b) && solverNext(s, &next)) {
+        ++moves;
+        if (step(s->b, &next))
+            return -1;
+        solverNote(s);
+        STATS_POLL();
+    }
+    return moves;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include "stats.h"
+
+#ifdef STATS
+
+Stats stats;
+volatile sig_atomic_t statsRequested;
+
+
+static void onSignal(int sig)
+{
+    (void)sig;
+    statsRequested = 1;
+}
+
+
+/* dump on SIGUSR1, blocking reads are interrupted so that the request is
+ * seen right away */
+void statsInit(void)
+{
+    struct sigaction sa;
+
+    sa.sa_handler = onSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+
+void statsDump(void)
+{
+    Stats s = stats;
+
+    fprintf(stderr, "{\"fills\": %ld, \"cells_opened\": %ld, "
+            "\"cells_per_fill\": %.2f, \"fill_max\": %ld, \"fill_depth\": %ld, "
+            "\"fill_spills\": %ld, \"gens\": %ld, \"gen_ns\": %ld, "
+            "\"labels\": %ld, \"label_ns\": %ld, "
+            "\"prints\": %ld, \"print_ns\": %ld, \"print_bytes\": %ld, "
+            "\"frame_bytes\": %ld, \"inputs\": %ld, \"input_ns\": %ld}\n",
+            s.fills, s.cellsOpened, s.fills ? (double)s.cellsOpened / s.fills : 0.,
+            s.fillMax, s.fillDepth, s.fillSpills, s.gens, s.genNs, s.labels, s.labelNs,
+            s.prints, s.printNs, s.printBytes, s.frameBytes, s.inputs, s.inputNs);
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "term.h"
+
+/* longest escape sequence is waited for this long to complete */
+#define ESC_MS  20
+
+#define HIDE    "\x1b[?25l"
+#define SHOW    "\x1b[?25h"
+
+static int inFd = -1, outFd = -1;
+static struct termios saved;
+
+/* bytes read but not decoded yet, the start of an escape sequence */
+static char pending[4];
+static int npending;
+
+
+/* best effort, the game goes on without cursor changes */
+static void put(const char *s)
+{
+    if (write(outFd, s, strlen(s)) < 0)
+        return;
+}
+
+
+/* put the terminal back even if killed */
+static void onSignal(int sig)
+{
+    termRestore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+/* switch the terminal on in to raw mode, the text cursor of out is hidden
+ * returns errorcode */
+int termRaw(int in, int out)
+{
+    struct termios t;
+
+    if (!isatty(in) || tcgetattr(in, &saved))
+        return -1;
+    t = saved;
+    /* ctrl-c arrives as a key, output keeps its newline translation */
+    t.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    t.c_cflag |= CS8;
+    t.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    if (tcsetattr(in, TCSAFLUSH, &t))
+        return -1;
+    inFd = in;
+    outFd = out;
+    atexit(termRestore);
+    signal(SIGTERM, onSignal);
+    signal(SIGHUP, onSignal);
+    put(HIDE);
+    return 0;
+}
+
+
+/* undo termRaw, safe to call more than once and from signal handlers */
+void termRestore(void)
+{
+    if (inFd < 0)
+        return;
+    tcsetattr(inFd, TCSAFLUSH, &saved);
+    put(SHOW);
+    inFd = -1;
+}
+
+
+/* decode cursor keys of both the normal and the application keypad
+ * returns length of the sequence at s, 0 if it is incomplete, -1 if s does
+ * not start one */
+static int escape(const char *s, int n, int *key)
+{
+    if (s[0] != '\x1b')
+        return -1;
+    if (n < 2)
+        return 0;
+    if (s[1] != '[' && s[1] != 'O')
+        return -1;
+    if (n < 3)
+        return 0;
+    switch (s[2]) {
+        case 'A': *key = KEY_UP;    return 3;
+        case 'B': *key = KEY_DOWN;  return 3;
+        case 'C': *key = KEY_RIGHT; return 3;
+        case 'D': *key = KEY_LEFT;  return 3;
+    }
+    return -1;
+}
+
+
+/* wait for keys and return all that are available, at most max, which
+ * must be more than the length of an escape sequence
+ * returns number of keys or errorcode, -2 if a signal interrupted the
+ * wait, -3 at the end of input */
+int readKeys(int *keys, int max)
+{
+    char buf[256];
+    struct pollfd p = { inFd, POLLIN, 0 };
+    int n, len, i, k, key;
+    bool more = false;
+
+    memcpy(buf, pending, npending);
+    len = npending;
+    npending = 0;
+    if (max > (int)sizeof(buf))
+        max = sizeof(buf);
+
+    /* block for the first key, a started escape sequence gets a moment */
+    if (poll(&p, 1, len ? ESC_MS : -1) < 0)
+        return errno == EINTR ? -2 : -1;
+    if (p.revents) {
+        /* every byte is at most one key */
+        n = read(inFd, buf + len, max - len);
+        if (n < 0)
+            return errno == EINTR ? -2 : -1;
+        if (n == 0 && !len)
+            return -3;
+        more = n > 0;
+        len += n;
+    }
+
+    for (i = 0, k = 0; i < len; ++k) {
+        n = escape(buf + i, len - i, &key);
+        if (n == 0 && !more) {
+            /* nothing followed in time, a lone escape key */
+            n = -1;
+        }
+        else if (n == 0) {
+            npending = len - i;
+            memcpy(pending, buf + i, npending);
+            break;
+        }
+        if (n < 0) {
+            keys[k] = (unsigned char)buf[i];
+            n = 1;
+        }
+        else {
+            keys[k] = key;
+        }
+        i += n;
+    }
+    return k;
+}
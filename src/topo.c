@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+
+/* neighbourhoods
+ *
+ * a board walks its neighbours through the offset table of its topology.
+ * square and torus boards count the 8 fields around, the torus joins
+ * opposite edges. hexagonal boards shift every odd row half a field to
+ * the right, so a field touches two fields above and two below. cross
+ * boards only count the 4 fields sharing an edge. */
+
+/* u, ur, r, dr, d, dl, l, ul */
+#define BOX_DX { 0,  1, 1, 1, 0, -1, -1, -1 }
+#define BOX_DY {-1, -1, 0, 1, 1,  1,  0, -1 }
+
+const Topology topologies[NTOPOS] = {
+    [TOPO_SQUARE] = { "square", 8, { BOX_DX, BOX_DX }, { BOX_DY, BOX_DY },
+        true, false, false },
+    [TOPO_TORUS] = { "torus", 8, { BOX_DX, BOX_DX }, { BOX_DY, BOX_DY },
+        true, true, false },
+    /* l, r, then the two above and the two below */
+    [TOPO_HEX] = { "hex", 6,
+        { { -1, 1, -1, 0, -1, 0 }, { -1, 1, 0, 1, 0, 1 } },
+        { { 0, 0, -1, -1, 1, 1 }, { 0, 0, -1, -1, 1, 1 } },
+        false, false, true },
+    /* u, r, d, l */
+    [TOPO_CROSS] = { "cross", 4,
+        { { 0, 1, 0, -1 }, { 0, 1, 0, -1 } },
+        { { -1, 0, 1, 0 }, { -1, 0, 1, 0 } },
+        false, false, false },
+};
+
+
+/* give the board another neighbourhood, before bombs are placed
+ * engines of fixed sizes only know the square one */
+void setTopology(Board *b, int topo)
+{
+    b->topo = &topologies[topo];
+    b->engine = topo == TOPO_SQUARE ? fixedEngine(b->w, b->h) : NULL;
+}
+
+
+/* returns index of the topology called name, -1 if there is none */
+int topologyByName(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NTOPOS; ++i)
+        if (!strcmp(topologies[i].name, name))
+            return i;
+    return -1;
+}